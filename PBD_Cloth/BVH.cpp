@@ -0,0 +1,170 @@
+#include "BVH.h"
+
+// minimum number of nodes handed to one task of the thread pool
+static const int NODE_GRAIN = 1024;
+
+void BVH::build(const std::vector<AABB>& primBounds)
+{
+	_numPrims = (int)primBounds.size();
+	_prims.resize(_numPrims);
+	for (int i = 0; i < _numPrims; ++i)
+		_prims[i] = i;
+	_nodes.clear();
+	_levelOffsets.assign(1, 0);
+	_buildCount++;
+	if (_numPrims == 0)
+	{
+		_buildCost = 0.0f;
+		return;
+	}
+
+	std::vector<Vec3f> centers(_numPrims);
+	for (int i = 0; i < _numPrims; ++i)
+		centers[i] = (primBounds[i].lo + primBounds[i].hi) * 0.5f;
+
+	// breadth first: the children of a node are appended behind the nodes of the current depth
+	std::vector<Vec2i> ranges(1, Vec2i(0, _numPrims));  // primitive range [begin, end) of each node
+	_nodes.resize(1);
+	int levelEnd = 1;
+	for (int n = 0; n < (int)_nodes.size(); ++n)
+	{
+		if (n == levelEnd)
+		{
+			_levelOffsets.push_back(n);
+			levelEnd = (int)_nodes.size();
+		}
+		int begin = ranges[n][0], end = ranges[n][1];
+		AABB box, centerBox;
+		for (int k = begin; k < end; ++k)
+		{
+			box.expand(primBounds[_prims[k]]);
+			centerBox.expand(centers[_prims[k]]);
+		}
+		_nodes[n].box = box;
+		if (end - begin <= LEAF_SIZE)
+		{
+			_nodes[n].first = begin;
+			_nodes[n].count = end - begin;
+			continue;
+		}
+
+		// median split along the longest axis of the centers
+		Vec3f extent = centerBox.hi - centerBox.lo;
+		int axis = extent[1] > extent[0] ? 1 : 0;
+		if (extent[2] > extent[axis])
+			axis = 2;
+		int mid = (begin + end) / 2;
+		std::nth_element(_prims.begin() + begin, _prims.begin() + mid, _prims.begin() + end, [&](int a, int b)
+		{
+			return centers[a][axis] < centers[b][axis];
+		});
+		_nodes[n].first = (int)_nodes.size();
+		_nodes[n].count = 0;
+		_nodes.resize(_nodes.size() + 2);
+		ranges.push_back(Vec2i(begin, mid));
+		ranges.push_back(Vec2i(mid, end));
+	}
+	_levelOffsets.push_back((int)_nodes.size());
+	_buildCost = cost();
+}
+
+void BVH::refit(const std::vector<AABB>& primBounds, ThreadPool* pool)
+{
+	// deepest level first; the nodes of one level only read the level below
+	for (int d = (int)_levelOffsets.size() - 2; d >= 0; --d)
+	{
+		auto refitNodes = [&](int begin, int end)
+		{
+			for (int n = begin; n < end; ++n)
+			{
+				Node& node = _nodes[n];
+				AABB box;
+				if (node.count > 0)
+				{
+					for (int k = node.first; k < node.first + node.count; ++k)
+						box.expand(primBounds[_prims[k]]);
+				}
+				else
+				{
+					box = _nodes[node.first].box;
+					box.expand(_nodes[node.first + 1].box);
+				}
+				node.box = box;
+			}
+		};
+		if (pool)
+			pool->parallelFor(_levelOffsets[d], _levelOffsets[d + 1], NODE_GRAIN, refitNodes);
+		else
+			refitNodes(_levelOffsets[d], _levelOffsets[d + 1]);
+	}
+}
+
+void BVH::update(const std::vector<AABB>& primBounds, ThreadPool* pool)
+{
+	if ((int)primBounds.size() != _numPrims || _nodes.empty())
+	{
+		build(primBounds);
+		return;
+	}
+	refit(primBounds, pool);
+	if (cost() > rebuildRatio * _buildCost)
+		build(primBounds);
+}
+
+void BVH::selfPairTasks(std::vector<Vec2i>& tasks, int minTasks) const
+{
+	tasks.clear();
+	if (_nodes.empty())
+		return;
+	tasks.push_back(Vec2i(0, 0));
+	// split all the pairs one level further until there are enough or only leaf pairs are left
+	std::vector<Vec2i> next;
+	bool split = true;
+	while ((int)tasks.size() < minTasks && split)
+	{
+		next.clear();
+		split = false;
+		for (size_t k = 0; k < tasks.size(); ++k)
+		{
+			if (_nodes[tasks[k][0]].count > 0 && _nodes[tasks[k][1]].count > 0)
+			{
+				next.push_back(tasks[k]);
+				continue;
+			}
+			splitPair(tasks[k], next);
+			split = true;
+		}
+		tasks.swap(next);
+	}
+}
+
+void BVH::splitPair(const Vec2i& pair, std::vector<Vec2i>& children) const
+{
+	const Node& a = _nodes[pair[0]];
+	const Node& b = _nodes[pair[1]];
+	if (pair[0] == pair[1])
+	{
+		children.push_back(Vec2i(a.first, a.first));
+		children.push_back(Vec2i(a.first + 1, a.first + 1));
+		if (_nodes[a.first].box.overlaps(_nodes[a.first + 1].box))
+			children.push_back(Vec2i(a.first, a.first + 1));
+		return;
+	}
+	// descend into the larger inner node
+	bool splitA = b.count > 0 || (a.count == 0 && surfaceArea(a.box) >= surfaceArea(b.box));
+	const Node& inner = splitA ? a : b;
+	for (int c = inner.first; c < inner.first + 2; ++c)
+	{
+		Vec2i child = splitA ? Vec2i(c, pair[1]) : Vec2i(pair[0], c);
+		if (_nodes[child[0]].box.overlaps(_nodes[child[1]].box))
+			children.push_back(child);
+	}
+}
+
+float BVH::cost() const
+{
+	float sum = 0.0f;
+	for (size_t n = 0; n < _nodes.size(); ++n)
+		sum += surfaceArea(_nodes[n].box);
+	return sum;
+}
@@ -0,0 +1,193 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include "Collider.h"
+#include "ThreadPool.h"
+
+// Bounding volume hierarchy over a fixed set of primitives (triangles, edges, ...) given by their boxes.
+// build() splits at the median of the longest axis of the box centers. The nodes are stored breadth
+// first, so the nodes of one depth are contiguous and refit() can update one level after the other,
+// each level in parallel. update() refits and only rebuilds once the refitted tree got much worse
+// than a fresh one (summed node surface area above rebuildRatio times the one after the last build).
+class BVH
+{
+public:
+	float rebuildRatio = 2.0f;
+
+	void build(const std::vector<AABB>& primBounds);
+	void refit(const std::vector<AABB>& primBounds, ThreadPool* pool = NULL);
+	void update(const std::vector<AABB>& primBounds, ThreadPool* pool = NULL);  // refit, rebuild if degraded
+	bool empty() const { return _nodes.empty(); }
+	AABB bounds() const { return _nodes.empty() ? AABB() : _nodes[0].box; }
+	int buildCount() const { return _buildCount; }
+
+	// func(prim) for every primitive whose box overlaps box
+	template<class F>
+	void query(const AABB& box, const F& func) const
+	{
+		if (_nodes.empty())
+			return;
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const Node& node = _nodes[stack[--top]];
+			if (!node.box.overlaps(box))
+				continue;
+			if (node.count > 0)
+			{
+				for (int k = node.first; k < node.first + node.count; ++k)
+					func(_prims[k]);
+			}
+			else
+			{
+				stack[top++] = node.first;
+				stack[top++] = node.first + 1;
+			}
+		}
+	}
+
+	// the primitive closest to p, where func(prim) gives the squared distance from p to the primitive; only
+	// primitives in nodes closer than sqrt(maxDist2) are looked at, nearer children first. maxDist2 shrinks to
+	// the distance of the closest one; returns -1 if there is none within the initial maxDist2
+	template<class F>
+	int nearest(const Vec3f& p, float& maxDist2, const F& func) const
+	{
+		if (_nodes.empty())
+			return -1;
+		int best = -1;
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const Node& node = _nodes[stack[--top]];
+			if (distance2(node.box, p) >= maxDist2)
+				continue;
+			if (node.count > 0)
+			{
+				for (int k = node.first; k < node.first + node.count; ++k)
+				{
+					float dist2 = func(_prims[k]);
+					if (dist2 < maxDist2)
+					{
+						maxDist2 = dist2;
+						best = _prims[k];
+					}
+				}
+			}
+			else
+			{
+				bool leftFirst = distance2(_nodes[node.first].box, p) <= distance2(_nodes[node.first + 1].box, p);
+				stack[top++] = leftFirst ? node.first + 1 : node.first;
+				stack[top++] = leftFirst ? node.first : node.first + 1;
+			}
+		}
+		return best;
+	}
+
+	// func(prim, otherPrim) for every pair of primitives of the two trees whose boxes overlap
+	template<class F>
+	void queryPairs(const BVH& other, const F& func) const
+	{
+		if (_nodes.empty() || other._nodes.empty())
+			return;
+		std::vector<std::pair<int, int> > stack(1, std::make_pair(0, 0));
+		while (!stack.empty())
+		{
+			std::pair<int, int> top = stack.back();
+			stack.pop_back();
+			const Node& a = _nodes[top.first];
+			const Node& b = other._nodes[top.second];
+			if (!a.box.overlaps(b.box))
+				continue;
+			if (a.count > 0 && b.count > 0)
+			{
+				for (int i = a.first; i < a.first + a.count; ++i)
+					for (int j = b.first; j < b.first + b.count; ++j)
+						func(_prims[i], other._prims[j]);
+			}
+			else if (b.count > 0 || (a.count == 0 && surfaceArea(a.box) >= surfaceArea(b.box)))
+			{
+				// descend into the larger inner node
+				stack.push_back(std::make_pair(a.first, top.second));
+				stack.push_back(std::make_pair(a.first + 1, top.second));
+			}
+			else
+			{
+				stack.push_back(std::make_pair(top.first, b.first));
+				stack.push_back(std::make_pair(top.first, b.first + 1));
+			}
+		}
+	}
+
+	// Node pairs that together cover every pair of overlapping leaves of the tree with itself, about minTasks of
+	// them (fewer for small trees); selfPairs() of each can run on its own thread
+	void selfPairTasks(std::vector<Vec2i>& tasks, int minTasks) const;
+
+	// func(prim, otherPrim) once for every unordered pair of distinct primitives in overlapping leaves below
+	// the node pair of a task from selfPairTasks(); func has to check the primitives' own boxes
+	template<class F>
+	void selfPairs(const Vec2i& task, const F& func) const
+	{
+		std::vector<Vec2i> stack(1, task);
+		std::vector<Vec2i> children;
+		while (!stack.empty())
+		{
+			Vec2i top = stack.back();
+			stack.pop_back();
+			const Node& a = _nodes[top[0]];
+			const Node& b = _nodes[top[1]];
+			if (a.count > 0 && b.count > 0)
+			{
+				for (int i = a.first; i < a.first + a.count; ++i)
+					for (int j = top[0] == top[1] ? i + 1 : b.first; j < b.first + b.count; ++j)
+						func(_prims[i], _prims[j]);
+				continue;
+			}
+			children.clear();
+			splitPair(top, children);
+			stack.insert(stack.end(), children.begin(), children.end());
+		}
+	}
+
+	static float surfaceArea(const AABB& box)
+	{
+		Vec3f e = box.hi - box.lo;
+		return 2 * (e[0] * e[1] + e[1] * e[2] + e[2] * e[0]);
+	}
+
+	static float distance2(const AABB& box, const Vec3f& p)  // squared distance from p to the box, 0 inside
+	{
+		float sum = 0.0f;
+		for (int k = 0; k < 3; ++k)
+			sum += sqr(max(box.lo[k] - p[k], p[k] - box.hi[k], 0.0f));
+		return sum;
+	}
+
+private:
+	static const int LEAF_SIZE = 4;
+
+	struct Node
+	{
+		AABB box;
+		int first;  // leaf: first index into _prims; inner node: index of the left child (the right one follows)
+		int count;  // primitives of a leaf; 0 for inner nodes
+	};
+
+	std::vector<Node> _nodes;  // breadth first, root at 0
+	std::vector<int> _levelOffsets;  // nodes of depth d are [offsets[d], offsets[d+1])
+	std::vector<int> _prims;  // primitive ids, grouped by leaf
+	float _buildCost = 0.0f;  // summed surface area of the nodes right after the last build
+	int _buildCount = 0;
+	int _numPrims = 0;
+
+	float cost() const;
+	// the overlapping pairs one level further down; a node paired with itself gives both children with
+	// themselves and with each other
+	void splitPair(const Vec2i& pair, std::vector<Vec2i>& children) const;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Hand-off of every value from one producer thread to one consumer thread, in order, with room for at most
+// capacity values. push() waits while the queue is full, so a consumer that falls behind slows the producer
+// down instead of the queue growing without bound; close() releases a waiting producer for good. The consumer
+// side never waits.
+template<class T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity) : _capacity(capacity) {}
+
+	// producer side: false if the queue was closed, and the value dropped
+	bool push(T value)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_notFull.wait(lock, [&]() { return _closed || _values.size() < _capacity; });
+		if (_closed)
+			return false;
+		_values.push_back(std::move(value));
+		return true;
+	}
+
+	// consumer side: take the oldest value; false if there is none
+	bool tryPop(T& value)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_values.empty())
+				return false;
+			value = std::move(_values.front());
+			_values.pop_front();
+		}
+		_notFull.notify_one();
+		return true;
+	}
+
+	void close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_closed = true;
+		}
+		_notFull.notify_all();
+	}
+
+private:
+	size_t _capacity;
+	std::deque<T> _values;
+	bool _closed = false;
+	std::mutex _mutex;
+	std::condition_variable _notFull;
+};
+
+#endif
@@ -1,4 +1,15 @@
 #include "Cloth.h"
+#include "Geometry.h"
+
+// minimum number of constraints / points handed to one task of the thread pool
+static const int CONSTRAINT_GRAIN = 2048;
+static const int POINT_GRAIN = 4096;
+// edge of the square tiles of points collisions are culled by
+static const int COLLISION_TILE = 16;
+// tiles near more colliders than this look up each point in the collider broadphase instead of testing them all
+static const int MAX_TILE_COLLIDERS = 8;
+// node pairs the triangle self-collision search is split into for the threads
+static const int CONTACT_TASKS = 64;
 
 
 void Cloth::initIndexArray()
@@ -15,22 +26,22 @@ void Cloth::initIndexArray()
 		for (int i = 0; i < resX - 1; ++i)
 		{
 			// 1
-			indexArray.push_back((GLuint)(j*resX + i));
+			indexArray.push_back((unsigned int)(j*resX + i));
 
 			// 2
-			indexArray.push_back((GLuint)((j + 1)*resX + i));//j*resX + i + 1
+			indexArray.push_back((unsigned int)((j + 1)*resX + i));//j*resX + i + 1
 
 			// 3
-			indexArray.push_back((GLuint)((j + 1)*resX + i + 1));
+			indexArray.push_back((unsigned int)((j + 1)*resX + i + 1));
 
 			// 4
-			indexArray.push_back((GLuint)(j*resX + i + 1)); //(j + 1)*resX + i + 1)
+			indexArray.push_back((unsigned int)(j*resX + i + 1)); //(j + 1)*resX + i + 1)
 
 			// 5
-			indexArray.push_back((GLuint)(j*resX + i)); // (j + 1)*resX + i)
+			indexArray.push_back((unsigned int)(j*resX + i)); // (j + 1)*resX + i)
 
 			// 6
-			indexArray.push_back((GLuint)((j + 1)*resX + i + 1));//j*resX + i
+			indexArray.push_back((unsigned int)((j + 1)*resX + i + 1));//j*resX + i
 
 			countVer += 6;
 		}
@@ -41,7 +52,92 @@ void Cloth::initIndexArray()
 void Cloth::init()
 {
 	createCloth(resX, resY, sizeX, sizeY, hasPosConstr);
+	colorConstraints(points.size(), distConstraintList, restLength, constraintColorOffsets);
+	buildPointAdjacency();
+	setCompliance(0.0f, 0.0f);
 	initIndexArray();
+	initTriangleEdges();
+}
+
+void Cloth::setThreadCount(int numThreads)
+{
+	if (numThreads == 1)
+		_ownThreadPool.reset();
+	else
+		_ownThreadPool = std::make_shared<ThreadPool>(numThreads);
+	_threadPool = _ownThreadPool.get();
+}
+
+void Cloth::setThreadPool(ThreadPool* pool)
+{
+	_ownThreadPool.reset();
+	_threadPool = pool;
+}
+
+void Cloth::setKernelISA(KernelISA isa)
+{
+	_kernelISA = detectKernelISA();
+	if (isa < _kernelISA)
+		_kernelISA = isa;
+	_distanceKernel = distanceKernel(_kernelISA);
+}
+
+void Cloth::setCompliance(float structural, float shear)
+{
+	int numConstraints = (int)distConstraintList.size();
+	compliance.resize(numConstraints);
+	for (int i = 0; i < numConstraints; ++i)
+	{
+		// shear constraints connect points that differ in both grid coordinates
+		int p1 = distConstraintList[i][0];
+		int p2 = distConstraintList[i][1];
+		bool isShear = (p1 % resX != p2 % resX) && (p1 / resX != p2 / resX);
+		compliance[i] = isShear ? shear : structural;
+	}
+	_lambda.assign(numConstraints, 0.0f);
+}
+
+void Cloth::colorConstraints(int numPoints, std::vector<Vec2i>& constraints, std::vector<float>& restLength, std::vector<int>& colorOffsets)
+{
+	// greedy coloring: each constraint takes the lowest color not used yet by either of its points,
+	// so constraints of the same color can be projected in parallel.
+	// the regular grids have at most 8 constraints per point, i.e. at most 15 colors
+	int numConstraints = (int)constraints.size();
+	std::vector<unsigned long long> usedColors(numPoints, 0);
+	std::vector<int> color(numConstraints);
+	int numColors = 0;
+	for (int i = 0; i < numConstraints; ++i)
+	{
+		int p1 = constraints[i][0];
+		int p2 = constraints[i][1];
+		unsigned long long used = usedColors[p1] | usedColors[p2];
+		int c = 0;
+		while (used & (1ull << c))
+			++c;
+		assert(c < 64);
+		usedColors[p1] |= 1ull << c;
+		usedColors[p2] |= 1ull << c;
+		color[i] = c;
+		numColors = max(numColors, c + 1);
+	}
+
+	// counting sort by color, keeping the creation order inside a color
+	colorOffsets.assign(numColors + 1, 0);
+	for (int i = 0; i < numConstraints; ++i)
+		colorOffsets[color[i] + 1]++;
+	for (int c = 0; c < numColors; ++c)
+		colorOffsets[c + 1] += colorOffsets[c];
+	std::vector<int> slot(colorOffsets.begin(), colorOffsets.end() - 1);
+	std::vector<Vec2i> sortedConstraints(numConstraints);
+	std::vector<float> sortedRestLength(numConstraints);
+	for (int i = 0; i < numConstraints; ++i)
+	{
+		int dst = slot[color[i]]++;
+		sortedConstraints[dst] = constraints[i];
+		sortedRestLength[dst] = restLength[i];
+	}
+	constraints.swap(sortedConstraints);
+	restLength.swap(sortedRestLength);
 }
 
 void Cloth::createCloth(int resX, int resY, float sizeX, float sizeY, bool hasPosConstr)
@@ -49,6 +145,9 @@ void Cloth::createCloth(int resX, int resY, float sizeX, float sizeY, bool hasPo
 	// setting up initial points positions
 	int totalPoints = resX * resY;
 	float shearRestLength = sqrt(sizeX*sizeX + sizeY * sizeY);
+	points.reserve(totalPoints);
+	distConstraintList.reserve(4 * totalPoints);
+	restLength.reserve(4 * totalPoints);
 	for (int j = 0; j < resY; ++j)
 	{
 		for (int i = 0; i < resX; ++i)
@@ -58,21 +157,14 @@ void Cloth::createCloth(int resX, int resY, float sizeX, float sizeY, bool hasPo
 			float newMass = 0.5f;
 
 			// initialize point constraint
-			Point newP;
-			newP.pos = newPos;
-			newP.vel = Vec3f(0.0f, 0.0f, 0.0f);
-			newP.accel = Vec3f(0.0f, 0.0f, 0.0f);
-
 			if (hasPosConstr && (j == resY - 1 && (i == 0 || i == resX - 1)))  // fix two points
 			{
-				newP.mass = INFINITY;
-				points.push_back(newP);
+				points.push_back(newPos, Vec3f(0.0f), 0.0f);  // infinite mass
 				_posConstraintList.push_back(newPos);
 			}
 			else
 			{
-				newP.mass = newMass;
-				points.push_back(newP);
+				points.push_back(newPos, Vec3f(0.0f), 1 / newMass);
 			}
 
 			// initialize constraint and restLength
@@ -106,100 +198,1169 @@ void Cloth::createCloth(int resX, int resY, float sizeX, float sizeY, bool hasPo
 	assert(distConstraintList.size() == restLength.size());
 }
 
-void Cloth::update(float deltaTime, float dampingRate, bool hasPosConstr, int solverIter, Vec3f sphereCenter, float sphereRadius)
+void Cloth::setHierarchyLevels(int numLevels)
+{
+	_levels.clear();
+	for (int l = 0; l < numLevels; ++l)
+	{
+		int stride = 2 << l;
+		if (stride >= resX - 1 && stride >= resY - 1)
+			break;  // a coarser level would not have any interior structure left
+		Level level;
+
+		// kept columns and rows; the last one is always kept so the border and the fixed corners are on every level
+		for (int i = 0; i < resX; i += stride)
+			level.cols.push_back(i);
+		if (level.cols.back() != resX - 1)
+			level.cols.push_back(resX - 1);
+		for (int j = 0; j < resY; j += stride)
+			level.rows.push_back(j);
+		if (level.rows.back() != resY - 1)
+			level.rows.push_back(resY - 1);
+		int numCols = (int)level.cols.size();
+		int numRows = (int)level.rows.size();
+		for (int b = 0; b < numRows; ++b)
+			for (int a = 0; a < numCols; ++a)
+				level.pointIndex.push_back(Vec2iToInt(level.cols[a], level.rows[b]));
+
+		// same stencil as createCloth, with rest lengths spanning the kept rows and columns
+		for (int b = 0; b < numRows; ++b)
+		{
+			for (int a = 0; a < numCols; ++a)
+			{
+				int origin = level.pointIndex[b * numCols + a];
+				const int offsets[4][2] = { { 1, 0 }, { 0, 1 }, { 1, 1 }, { -1, 1 } };
+				for (int k = 0; k < 4; ++k)
+				{
+					int na = a + offsets[k][0];
+					int nb = b + offsets[k][1];
+					if (na < 0 || na >= numCols || nb >= numRows)
+						continue;
+					float dx = (level.cols[na] - level.cols[a]) * sizeX;
+					float dy = (level.rows[nb] - level.rows[b]) * sizeY;
+					level.constraints.push_back(Vec2i(origin, level.pointIndex[nb * numCols + na]));
+					level.restLength.push_back(sqrt(dx * dx + dy * dy));
+				}
+			}
+		}
+		colorConstraints(points.size(), level.constraints, level.restLength, level.colorOffsets);
+
+		// bilinear interpolation of the coarse corrections: fine column i lies in [cols[colCell[i]], cols[colCell[i] + 1]]
+		level.colCell.resize(resX);
+		level.colFrac.resize(resX);
+		for (int a = 0, i = 0; i < resX; ++i)
+		{
+			while (a + 2 < numCols && level.cols[a + 1] <= i)
+				++a;
+			level.colCell[i] = a;
+			level.colFrac[i] = (float)(i - level.cols[a]) / (level.cols[a + 1] - level.cols[a]);
+		}
+		level.rowCell.resize(resY);
+		level.rowFrac.resize(resY);
+		for (int b = 0, j = 0; j < resY; ++j)
+		{
+			while (b + 2 < numRows && level.rows[b + 1] <= j)
+				++b;
+			level.rowCell[j] = b;
+			level.rowFrac[j] = (float)(j - level.rows[b]) / (level.rows[b + 1] - level.rows[b]);
+		}
+		level.startPos.resize(level.pointIndex.size());
+		_levels.push_back(level);
+	}
+}
+
+void Cloth::solveLevel(Level& level)
 {
+	Vec3f* predPos = points.predPos.data();
+	const float* invMass = points.invMass.data();
+	int numCoarse = (int)level.pointIndex.size();
+	for (int k = 0; k < numCoarse; ++k)
+		level.startPos[k] = predPos[level.pointIndex[k]];
+
+	// XPBD has no k_stiff; the coarse levels only have to get the low frequencies close
+	float stiffness = solverType == XPBD ? 1.0f : k_stiff;
+	int numColors = (int)level.colorOffsets.size() - 1;
+	for (int iter = 0; iter < coarseIterations; ++iter)
+	{
+		for (int c = 0; c < numColors; ++c)
+		{
+			parallelFor(level.colorOffsets[c], level.colorOffsets[c + 1], CONSTRAINT_GRAIN, [&](int begin, int end)
+			{
+				_distanceKernel(predPos, invMass, level.constraints.data(), level.restLength.data(), begin, end, stiffness);
+			});
+		}
+	}
+
+	// prolongate: the coarse points already moved, every other point gets the bilinear blend of the corrections around it
+	int numCols = (int)level.cols.size();
+	parallelFor(0, resY, max(1, POINT_GRAIN / resX), [&](int rowBegin, int rowEnd)
+	{
+		for (int j = rowBegin; j < rowEnd; ++j)
+		{
+			int b = level.rowCell[j];
+			float fy = level.rowFrac[j];
+			bool onRow = fy == 0.0f || fy == 1.0f;
+			for (int i = 0; i < resX; ++i)
+			{
+				int a = level.colCell[i];
+				float fx = level.colFrac[i];
+				int idx = Vec2iToInt(i, j);
+				if (invMass[idx] == 0 || (onRow && (fx == 0.0f || fx == 1.0f)))
+					continue;
+				int k = b * numCols + a;
+				Vec3f d00 = predPos[level.pointIndex[k]] - level.startPos[k];
+				Vec3f d10 = predPos[level.pointIndex[k + 1]] - level.startPos[k + 1];
+				Vec3f d01 = predPos[level.pointIndex[k + numCols]] - level.startPos[k + numCols];
+				Vec3f d11 = predPos[level.pointIndex[k + numCols + 1]] - level.startPos[k + numCols + 1];
+				predPos[idx] += bilerp(d00, d10, d01, d11, fx, fy);
+			}
+		}
+	});
+}
+
+void Cloth::buildPointAdjacency()
+{
+	int numPoints = points.size();
+	int numConstraints = (int)distConstraintList.size();
+	_pointConstraintOffsets.assign(numPoints + 1, 0);
+	for (int i = 0; i < numConstraints; ++i)
+	{
+		_pointConstraintOffsets[distConstraintList[i][0] + 1]++;
+		_pointConstraintOffsets[distConstraintList[i][1] + 1]++;
+	}
+	for (int i = 0; i < numPoints; ++i)
+		_pointConstraintOffsets[i + 1] += _pointConstraintOffsets[i];
+	std::vector<int> slot(_pointConstraintOffsets.begin(), _pointConstraintOffsets.end() - 1);
+	_pointConstraints.resize(2 * numConstraints);
+	_pointNeighbors.resize(2 * numConstraints);
+	for (int i = 0; i < numConstraints; ++i)
+	{
+		_pointNeighbors[slot[distConstraintList[i][0]]] = distConstraintList[i][1];
+		_pointConstraints[slot[distConstraintList[i][0]]++] = 2 * i;
+		_pointNeighbors[slot[distConstraintList[i][1]]] = distConstraintList[i][0];
+		_pointConstraints[slot[distConstraintList[i][1]]++] = 2 * i + 1;
+	}
+	_constraintDelta.resize(numConstraints);
+}
+
+void Cloth::update(float deltaTime, float dampingRate, bool hasPosConstr, int solverIter)
+{
+	predict(deltaTime, dampingRate);
+	solve(deltaTime, hasPosConstr, solverIter);
+}
+
+void Cloth::predict(float deltaTime, float dampingRate)
+{
+	int numPoints = points.size();
+	const Vec3f* pos = points.pos.data();
+	Vec3f* predPos = points.predPos.data();
+	Vec3f* vel = points.vel.data();
+	const float* invMass = points.invMass.data();
+
 	// printf("updating... %f\n", deltaTime);
 	// external forces (gravity ONLY)
 	// --------------------------------
 	Vec3f gravity = Vec3f(0, -9.8f, 0);
-	for (int i = 0; i < this->points.size(); ++i)
+	float damping = pow((1 - dampingRate), deltaTime);
+	auto predictPoints = [&](int begin, int end)
 	{
-		if (this->points[i].mass != 0) // should always be true
+		AABB box;
+		for (int i = begin; i < end; ++i)
 		{
-			if (!(i == resX * (resY - 1) || i == (resX * resY) - 1))  // do not conserve external forces
+			if (invMass[i] != 0) // fixed points do not conserve external forces
 			{
-				float invMass = 1 / this->points[i].mass;
-				this->points[i].vel += deltaTime * invMass*gravity;
+				vel[i] += deltaTime * invMass[i] * gravity;
 				// COARSE: damping velocities
-				this->points[i].vel *= pow((1- dampingRate), deltaTime);
+				vel[i] *= damping;
 			}
 
 			// add the predicted position with velocities
-			this->points[i].predPos = this->points[i].pos + deltaTime * this->points[i].vel;
+			predPos[i] = pos[i] + deltaTime * vel[i];
+			box.expand(pos[i]);
+			box.expand(predPos[i]);
 		}
-	}
+		return box;
+	};
+	if (_threadPool)
+		_sweptBounds = _threadPool->parallelReduce(0, numPoints, POINT_GRAIN, AABB(), predictPoints,
+			[](AABB a, const AABB& b) { a.expand(b); return a; });
+	else
+		_sweptBounds = predictPoints(0, numPoints);
+}
+
+void Cloth::solve(float deltaTime, bool hasPosConstr, int solverIter)
+{
+	int numPoints = points.size();
+	Vec3f* pos = points.pos.data();
+	Vec3f* predPos = points.predPos.data();
+	Vec3f* vel = points.vel.data();
+	const float* invMass = points.invMass.data();
 
 	// project constraints (ONLY distance contraints and position contraints for now)
 	// ---------------------------------
+	// coarse levels first, coarsest to finest
+	for (int l = (int)_levels.size() - 1; l >= 0; --l)
+		solveLevel(_levels[l]);
+
+	int numColors = (int)constraintColorOffsets.size() - 1;
+	if (solverType == XPBD)
+	{
+		// warm start: begin from the multipliers of the previous substep, rescaled to this time step
+		float lambdaScale = 0.0f;
+		if (_lambdaDeltaTime > 0.0f)
+			lambdaScale = xpbdWarmStart * sqr(deltaTime / _lambdaDeltaTime);
+		_lambdaDeltaTime = deltaTime;
+		for (int c = 0; c < numColors; ++c)
+		{
+			parallelFor(constraintColorOffsets[c], constraintColorOffsets[c + 1], CONSTRAINT_GRAIN, [&](int begin, int end)
+			{
+				warmStartXPBD(begin, end, lambdaScale);
+			});
+		}
+	}
+
+	// colliders added since the last update
+	bool hasColliders = colliders && colliders->size() > 0;
+	if (hasColliders)
+	{
+		if (!colliders->built())
+			colliders->build();
+		// contacts within the margin of the prediction, for the moves of the iterations
+		float margin = contactMargin > 0.0f ? contactMargin : 0.5f * max(sizeX, sizeY);
+		cullCollisionTiles(margin);
+		if (continuousCollision)
+			sweepCollisions(deltaTime);
+		findCollisionContacts(margin);
+	}
+
+	// neighbor lookup for the self-collisions of this substep
+	float defaultThickness = 0.5f * min(sizeX, sizeY);
+	float thickness = selfCollisionThickness > 0.0f ? selfCollisionThickness : defaultThickness;
+	float triangleThickness = triangleCollisionThickness > 0.0f ? triangleCollisionThickness : defaultThickness;
+	if (selfCollision)
+		findSelfCollisionCandidates(1.5f * thickness);  // margin for the moves of the iterations
+	if (triangleSelfCollision)
+		findTriangleContacts(triangleThickness);
+
+	// other cloths' contacts, grouped by point
+	bool hasExternalContacts = !externalContacts.empty();
+	if (hasExternalContacts)
+	{
+		std::stable_sort(externalContacts.begin(), externalContacts.end(), [](const ContactPlane& a, const ContactPlane& b)
+		{
+			return a.point < b.point;
+		});
+		_externalOffsets.assign(numPoints + 1, 0);
+		for (size_t c = 0; c < externalContacts.size(); ++c)
+			_externalOffsets[externalContacts[c].point + 1]++;
+		for (int i = 0; i < numPoints; ++i)
+			_externalOffsets[i + 1] += _externalOffsets[i];
+	}
+
+	// Chebyshev semi-iterative acceleration keeps the last two iterates in _chebyshevIterate; both start at the
+	// predicted positions, so nothing is extrapolated from zeros or from the previous substep
+	bool accelerate = chebyshev && solverIter > chebyshevDelay;
+	if (accelerate)
+	{
+		for (int k = 0; k < 2; ++k)
+		{
+			_chebyshevIterate[k].resize(numPoints);
+			std::copy(points.predPos.begin(), points.predPos.end(), _chebyshevIterate[k].begin());
+		}
+	}
+	// first accelerated iteration; the first iteration has no previous iterate and is always plain, as the
+	// sequence starts with omega_1 = 1, omega_2 = 2 / (2 - rho^2)
+	int chebyshevStart = max(chebyshevDelay, 1);
+	float omega = 1.0f;
+	float prevResidual = 0.0f;
 	for (int iter = 0; iter < solverIter; iter++)
 	{
 		// distance contraint
-		for (int i = 0; i < distConstraintList.size(); ++i)
-		{
-			Vec2i currDistConstr = distConstraintList[i]; // point-pair
-			float currRestLength = restLength[i];
-			Point pt1 = points[currDistConstr[0]];
-			Point pt2 = points[currDistConstr[1]];
-			Vec3f p1 = pt1.predPos;
-			Vec3f p2 = pt2.predPos;
+		float residual = projectDistanceIteration(deltaTime);
 
-			Vec3f vecP2P1 = p1 - p2;
-			float magP2P1 = mag(vecP2P1);
-			if (magP2P1 <= M_EPSION)
-				return;
-			float w1 = 1 / pt1.mass;
-			float w2 = 1 / pt2.mass;
-			float invMass = w1 + w2;
-			if (invMass <= M_EPSION)
-				return;
-
-			Vec3f n_val = vecP2P1 / magP2P1;  // direction
-			float s_val = (magP2P1 - currRestLength) * (1 / invMass);  // scaler
-
-			Vec3f distProj = s_val * n_val * k_stiff;
-			if (w1 > 0.0) // should always be true
-				points[currDistConstr[0]].predPos -= (distProj * w1);
-			if (w2 > 0.0) // should always be true
-				points[currDistConstr[1]].predPos += (distProj * w2);
+		if (accelerate)
+		{
+			if (iter < chebyshevStart)
+			{
+				// the plain iterations converge roughly like rho^k; learn rho from them unless it is given
+				if (chebyshevRho <= 0.0f && iter > 0 && prevResidual > 0.0f)
+					_rhoEstimate = 0.5f * _rhoEstimate + 0.5f * clamp(residual / prevResidual, 0.0f, 0.999f);
+				omega = 1.0f;
+			}
+			else if (omega > 1.0f && residual > prevResidual)
+			{
+				// oscillating: fall back to a plain iteration and restart the sequence with a smaller rho
+				omega = 1.0f;
+				chebyshevStart = iter + 1;
+				_rhoEstimate *= 0.9f;
+			}
+			else
+			{
+				float rho = chebyshevRho > 0.0f ? chebyshevRho : _rhoEstimate;
+				omega = iter == chebyshevStart ? 2 / (2 - rho * rho) : 4 / (4 - rho * rho * omega);
+			}
+			// x_k+1 = omega * (x^_k+1 - x_k-1) + x_k-1; x_k-1 is overwritten with x_k+1 for the next iteration
+			Vec3f* older = _chebyshevIterate[(iter + 1) % 2].data();
+			parallelFor(0, numPoints, POINT_GRAIN, [&](int begin, int end)
+			{
+				for (int i = begin; i < end; ++i)
+				{
+					if (omega != 1.0f && invMass[i] != 0)
+						predPos[i] = older[i] + omega * (predPos[i] - older[i]);
+					older[i] = predPos[i];
+				}
+			});
 		}
+		prevResidual = residual;
+
 		// position constraint
 		if (hasPosConstr)
 			setPositionConstraint();
 		
 		// collision constraints
-		for (int i = 0; i < points.size(); ++i)
+		if (selfCollision)
+			projectSelfCollisions(thickness);
+		if (triangleSelfCollision)
+			projectTriangleContacts(triangleThickness);
+		if (hasExternalContacts)
+			projectExternalContacts();
+		if (hasColliders)
+			projectCollisions(deltaTime);
+
+		// early termination: this sweep hardly had anything left to correct
+		_lastIterationCount = iter + 1;
+		_lastResidual = residual;
+		if (residual <= residualTolerance)
+			break;
+	}
+
+	// commit the velocity and the position changes
+	// ---------------------------------
+	float invDeltaTime = 1 / deltaTime;
+	parallelFor(0, numPoints, POINT_GRAIN, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
 		{
-			Vec3f p2c = points[i].predPos - sphereCenter; // distance between current predpos to the center of the sphere
-			float dist = mag(p2c); 
-			// collision detection
-			if (dist - sphereRadius < M_EPSION) // collide with the sphere
+			// commit velosity based on position changes
+			vel[i] = (predPos[i] - pos[i]) * invDeltaTime;
+			// commit position
+			pos[i] = predPos[i];
+		}
+	});
+	externalContacts.clear();
+}
+
+int Cloth::tileCountX() const
+{
+	return (resX + COLLISION_TILE - 1) / COLLISION_TILE;
+}
+
+int Cloth::tileCountY() const
+{
+	return (resY + COLLISION_TILE - 1) / COLLISION_TILE;
+}
+
+void Cloth::cullCollisionTiles(float margin)
+{
+	int numTilesX = tileCountX();
+	int numTiles = numTilesX * tileCountY();
+	_tileColliders.resize(numTiles);
+	const Vec3f* pos = points.pos.data();
+	const Vec3f* predPos = points.predPos.data();
+	parallelFor(0, numTiles, 1, [&](int begin, int end)
+	{
+		for (int t = begin; t < end; ++t)
+		{
+			int i0 = (t % numTilesX) * COLLISION_TILE;
+			int j0 = (t / numTilesX) * COLLISION_TILE;
+			AABB box;
+			for (int j = j0; j < min(j0 + COLLISION_TILE, resY); ++j)
 			{
-				float distToGo = sphereRadius - dist; // the distance to set the current predpos to the surface of the sphere
-				points[i].predPos += p2c * distToGo;  // direction * distance
+				for (int i = i0; i < min(i0 + COLLISION_TILE, resX); ++i)
+				{
+					box.expand(pos[j * resX + i]);
+					box.expand(predPos[j * resX + i]);
+				}
 			}
+			box.inflate(margin);
+			colliders->query(box, _tileColliders[t]);
 		}
+	});
+}
+
+void Cloth::findCollisionContacts(float margin)
+{
+	int numTilesX = tileCountX();
+	int numTiles = numTilesX * tileCountY();
+	const Vec3f* predPos = points.predPos.data();
+	_tileContacts.resize(numTiles);
+	parallelFor(0, numTiles, 1, [&](int begin, int end)
+	{
+		std::vector<int> pointColliders;
+		for (int t = begin; t < end; ++t)
+		{
+			std::vector<ContactPlane>& contacts = _tileContacts[t];
+			contacts.clear();
+			const std::vector<int>& tileColliders = _tileColliders[t];
+			if (tileColliders.empty())
+				continue;  // nothing near this part of the cloth
+			int i0 = (t % numTilesX) * COLLISION_TILE;
+			int j0 = (t / numTilesX) * COLLISION_TILE;
+			bool crowded = (int)tileColliders.size() > MAX_TILE_COLLIDERS;
+			for (int j = j0; j < min(j0 + COLLISION_TILE, resY); ++j)
+			{
+				for (int i = i0; i < min(i0 + COLLISION_TILE, resX); ++i)
+				{
+					int p = j * resX + i;
+					if (crowded)
+						colliders->query(AABB(predPos[p] - Vec3f(margin), predPos[p] + Vec3f(margin)), pointColliders);
+					const std::vector<int>& candidates = crowded ? pointColliders : tileColliders;
+					for (size_t c = 0; c < candidates.size(); ++c)
+					{
+						ContactPlane contact;
+						contact.point = p;
+						if (!colliders->contactPlane(predPos[p], candidates[c], margin, contact.normal, contact.offset, contact.velocity))
+							continue;
+						contacts.push_back(contact);
+					}
+				}
+			}
+		}
+	});
+}
+
+void Cloth::projectCollisions(float deltaTime)
+{
+	const Vec3f* pos = points.pos.data();
+	Vec3f* predPos = points.predPos.data();
+	// the contacts of one point are consecutive and the tiles share no points, so the tiles run in parallel
+	parallelFor(0, (int)_tileContacts.size(), 1, [&](int begin, int end)
+	{
+		for (int t = begin; t < end; ++t)
+		{
+			const std::vector<ContactPlane>& contacts = _tileContacts[t];
+			for (size_t c = 0; c < contacts.size(); ++c)
+			{
+				const ContactPlane& contact = contacts[c];
+				Vec3f& x = predPos[contact.point];
+				float depth = contact.offset - dot(x, contact.normal);
+				if (depth <= 0.0f)
+					continue;
+				x += contact.normal * depth;  // onto the plane along its normal
+				if (friction > 0.0f)
+				{
+					// slip along the surface this substep, relative to the surface; static friction takes all of it
+					// back while it is shorter than friction * depth, kinetic friction that much (Macklin et al. 2014)
+					Vec3f slip = x - pos[contact.point] - contact.velocity * deltaTime;
+					slip -= contact.normal * dot(slip, contact.normal);
+					float len = mag(slip);
+					float limit = friction * depth;
+					x -= len <= limit ? slip : slip * (limit / len);
+				}
+			}
+		}
+	});
+}
+
+void Cloth::projectExternalContacts()
+{
+	Vec3f* predPos = points.predPos.data();
+	const float* invMass = points.invMass.data();
+	const ContactPlane* contacts = externalContacts.data();
+	parallelFor(0, points.size(), POINT_GRAIN, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			if (invMass[i] == 0)
+				continue;
+			for (int c = _externalOffsets[i]; c < _externalOffsets[i + 1]; ++c)
+			{
+				float depth = contacts[c].offset - dot(predPos[i], contacts[c].normal);
+				if (depth > 0.0f)
+					predPos[i] += contacts[c].normal * depth;
+			}
+		}
+	});
+}
+
+bool Cloth::isConnected(int p1, int p2) const
+{
+	for (int k = _pointConstraintOffsets[p1]; k < _pointConstraintOffsets[p1 + 1]; ++k)
+	{
+		if (_pointNeighbors[k] == p2)
+			return true;
 	}
+	return false;
+}
 
-	// commit the velocity and the position changes
-	// ---------------------------------
-	for (int i = 0; i < this->points.size(); ++i)
+void Cloth::findSelfCollisionCandidates(float radius)
+{
+	int numPoints = points.size();
+	const Vec3f* predPos = points.predPos.data();
+	// the hash finds everything within half a cell
+	_selfCollisionHash.build(predPos, numPoints, 2 * radius, _threadPool);
+
+	// candidates of consecutive chunks of points, then concatenated in order
+	int numChunks = (numPoints + POINT_GRAIN - 1) / POINT_GRAIN;
+	float radius2 = radius * radius;
+	_selfCollisionChunks.resize(numChunks);
+	_selfCollisionOffsets.resize(numPoints + 1);
+	_selfCollisionOffsets[0] = 0;
+	parallelFor(0, numChunks, 1, [&](int chunkBegin, int chunkEnd)
+	{
+		for (int c = chunkBegin; c < chunkEnd; ++c)
+		{
+			std::vector<int>& chunk = _selfCollisionChunks[c];
+			chunk.clear();
+			for (int i = c * POINT_GRAIN; i < min((c + 1) * POINT_GRAIN, numPoints); ++i)
+			{
+				_selfCollisionHash.forEachNeighbor(predPos[i], [&](int j)
+				{
+					if (j != i && dist2(predPos[i], predPos[j]) < radius2 && !isConnected(i, j))
+						chunk.push_back(j);
+				});
+				_selfCollisionOffsets[i + 1] = (int)chunk.size();
+			}
+		}
+	});
+	std::vector<int> chunkStart(numChunks + 1, 0);
+	for (int c = 0; c < numChunks; ++c)
+		chunkStart[c + 1] = chunkStart[c] + (int)_selfCollisionChunks[c].size();
+	_selfCollisionCandidates.resize(chunkStart[numChunks]);
+	parallelFor(0, numChunks, 1, [&](int chunkBegin, int chunkEnd)
+	{
+		for (int c = chunkBegin; c < chunkEnd; ++c)
+		{
+			std::copy(_selfCollisionChunks[c].begin(), _selfCollisionChunks[c].end(), _selfCollisionCandidates.begin() + chunkStart[c]);
+			for (int i = c * POINT_GRAIN; i < min((c + 1) * POINT_GRAIN, numPoints); ++i)
+				_selfCollisionOffsets[i + 1] += chunkStart[c];  // was relative to the chunk
+		}
+	});
+}
+
+void Cloth::projectSelfCollisions(float thickness)
+{
+	int numPoints = points.size();
+	Vec3f* predPos = points.predPos.data();
+	const float* invMass = points.invMass.data();
+	const int* offsets = _selfCollisionOffsets.data();
+	const int* candidates = _selfCollisionCandidates.data();
+	_selfCollisionDelta.resize(numPoints);
+	Vec3f* delta = _selfCollisionDelta.data();
+	float thickness2 = thickness * thickness;
+	parallelFor(0, numPoints, POINT_GRAIN, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			delta[i] = Vec3f(0.0f);
+			if (invMass[i] == 0)
+				continue;
+			Vec3f sum(0.0f);
+			int count = 0;
+			for (int k = offsets[i]; k < offsets[i + 1]; ++k)
+			{
+				int j = candidates[k];
+				Vec3f vecJI = predPos[i] - predPos[j];
+				float dist2 = mag2(vecJI);
+				if (dist2 >= thickness2 || dist2 <= M_EPSION)
+					continue;
+				// this point's share of separating the pair to the thickness
+				float dist = sqrt(dist2);
+				sum += vecJI * ((thickness - dist) / dist * invMass[i] / (invMass[i] + invMass[j]));
+				count++;
+			}
+			if (count > 0)
+				delta[i] = sum / (float)count;
+		}
+	});
+	parallelFor(0, numPoints, POINT_GRAIN, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+			predPos[i] += delta[i];
+	});
+}
+
+void Cloth::initTriangleEdges()
+{
+	// sort the 3 edges of every triangle by their end points to find the unique ones
+	int numTriangles = (int)indexArray.size() / 3;
+	std::vector<std::pair<Vec2i, int> > halfEdges;  // (edge, triangle * 3 + k)
+	halfEdges.reserve(numTriangles * 3);
+	for (int t = 0; t < numTriangles; ++t)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			int a = (int)indexArray[3 * t + k];
+			int b = (int)indexArray[3 * t + (k + 1) % 3];
+			halfEdges.push_back(std::make_pair(Vec2i(min(a, b), max(a, b)), 3 * t + k));
+		}
+	}
+	std::sort(halfEdges.begin(), halfEdges.end(), [](const std::pair<Vec2i, int>& x, const std::pair<Vec2i, int>& y)
+	{
+		if (x.first[0] != y.first[0])
+			return x.first[0] < y.first[0];
+		return x.first[1] != y.first[1] ? x.first[1] < y.first[1] : x.second < y.second;
+	});
+	_edges.clear();
+	_triangleEdges.resize(numTriangles);
+	_triangleOwns.assign(numTriangles, 0);
+	for (size_t h = 0; h < halfEdges.size(); ++h)
+	{
+		int t = halfEdges[h].second / 3, k = halfEdges[h].second % 3;
+		if (h == 0 || halfEdges[h].first != halfEdges[h - 1].first)
+		{
+			_edges.push_back(halfEdges[h].first);
+			_triangleOwns[t] |= 8 << k;  // the first triangle of the edge
+		}
+		_triangleEdges[t][k] = (int)_edges.size() - 1;
+	}
+	std::vector<bool> owned(points.size(), false);
+	for (int t = 0; t < numTriangles; ++t)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			if (!owned[indexArray[3 * t + k]])
+			{
+				owned[indexArray[3 * t + k]] = true;
+				_triangleOwns[t] |= 1 << k;
+			}
+		}
+	}
+}
+
+void Cloth::updateTriangleBVH(float margin)
+{
+	int numTriangles = (int)_triangleEdges.size();
+	int numEdges = (int)_edges.size();
+	const Vec3f* pos = points.pos.data();
+	const Vec3f* predPos = points.predPos.data();
+	const unsigned int* tris = indexArray.data();
+
+	// the swept triangles for the BVH, and the swept edges for the edge-edge tests
+	_triangleBounds.resize(numTriangles);
+	_edgeBounds.resize(numEdges);
+	parallelFor(0, max(numTriangles, numEdges), POINT_GRAIN, [&](int begin, int end)
+	{
+		for (int t = begin; t < min(end, numTriangles); ++t)
+		{
+			AABB box;
+			for (int k = 0; k < 3; ++k)
+			{
+				box.expand(pos[tris[3 * t + k]]);
+				box.expand(predPos[tris[3 * t + k]]);
+			}
+			box.inflate(margin);
+			_triangleBounds[t] = box;
+		}
+		for (int e = begin; e < min(end, numEdges); ++e)
+		{
+			AABB box;
+			for (int k = 0; k < 2; ++k)
+			{
+				box.expand(pos[_edges[e][k]]);
+				box.expand(predPos[_edges[e][k]]);
+			}
+			box.inflate(margin);
+			_edgeBounds[e] = box;
+		}
+	});
+	_triangleBVH.update(_triangleBounds, _threadPool);
+}
+
+void Cloth::findTriangleContacts(float thickness)
+{
+	const Vec3f* pos = points.pos.data();
+	const Vec3f* predPos = points.predPos.data();
+	const unsigned int* tris = indexArray.data();
+	float radius = 1.5f * thickness;  // margin for the moves of the iterations
+
+	// boxes thickened by half the radius overlap for all pairs closer than the radius
+	updateTriangleBVH(0.5f * radius);
+
+	// a pair is a contact if it is close at predPos, or if it ends up on the other side of where it started
+	auto keepContact = [&](SelfContact& contact, const Vec3f& startNormal)
+	{
+		Vec3f start(0.0f), end(0.0f);
+		for (int k = 0; k < 4; ++k)
+		{
+			start += pos[contact.vertex[k]] * contact.weight[k];
+			end += predPos[contact.vertex[k]] * contact.weight[k];
+		}
+		contact.normal = dot(start, startNormal) < 0.0f ? -startNormal : startNormal;
+		float endDist = mag(end);
+		return endDist < radius || (dot(end, contact.normal) < 0.0f && endDist < radius + mag(end - start));
+	};
+
+	// A point is tested from the first triangle it belongs to (whose box contains the point's), an edge pair from
+	// the first triangles of both edges, so every vertex-triangle and edge-edge pair comes up once
+	auto testTriangles = [&](int t, int u, std::vector<SelfContact>& chunk)
+	{
+		int a = tris[3 * u], b = tris[3 * u + 1], d = tris[3 * u + 2];
+
+		// points of t against the triangle u
+		for (int k = 0; k < 3; ++k)
+		{
+			int v = tris[3 * t + k];
+			if (!(_triangleOwns[t] & (1 << k)) || v == a || v == b || v == d)
+				continue;
+			AABB pointBox;
+			pointBox.expand(pos[v]);
+			pointBox.expand(predPos[v]);
+			pointBox.inflate(0.5f * radius);
+			if (!pointBox.overlaps(_triangleBounds[u]) || isConnected(v, a) || isConnected(v, b) || isConnected(v, d))
+				continue;
+			Vec3f uvw;
+			Vec3f closest = closestPointOnTriangle(predPos[v], predPos[a], predPos[b], predPos[d]);
+			Vec3f normal = cross(pos[b] - pos[a], pos[d] - pos[a]);
+			float area = mag(normal);
+			if (area <= M_EPSION || !barycentric(closest, predPos[a], predPos[b], predPos[d], uvw))
+				continue;
+			SelfContact contact = { { v, a, b, d }, { 1.0f, -uvw[0], -uvw[1], -uvw[2] }, Vec3f(0.0f) };
+			if (keepContact(contact, normal / area))
+				chunk.push_back(contact);
+		}
+		if (t > u)
+			return;  // the edges once per triangle pair
+
+		// edges of t against the edges of u
+		for (int k = 0; k < 3; ++k)
+		{
+			if (!(_triangleOwns[t] & (8 << k)))
+				continue;
+			int e = _triangleEdges[t][k];
+			int p0 = _edges[e][0], p1 = _edges[e][1];
+			for (int j = 0; j < 3; ++j)
+			{
+				int e2 = _triangleEdges[u][j];
+				if (!(_triangleOwns[u] & (8 << j)) || !_edgeBounds[e].overlaps(_edgeBounds[e2]))
+					continue;
+				int q0 = _edges[e2][0], q1 = _edges[e2][1];
+				if (p0 == q0 || p0 == q1 || p1 == q0 || p1 == q1
+					|| isConnected(p0, q0) || isConnected(p0, q1) || isConnected(p1, q0) || isConnected(p1, q1))
+					continue;
+				float s, r;
+				closestPointsOnSegments(predPos[p0], predPos[p1], predPos[q0], predPos[q1], s, r);
+				SelfContact contact = { { p0, p1, q0, q1 }, { 1.0f - s, s, r - 1.0f, -r }, Vec3f(0.0f) };
+				// the edges' separation at the start of the substep gives the side
+				Vec3f start = pos[p0] * (1.0f - s) + pos[p1] * s - pos[q0] * (1.0f - r) - pos[q1] * r;
+				float startDist = mag(start);
+				if (startDist > M_EPSION && keepContact(contact, start / startDist))
+					chunk.push_back(contact);
+			}
+		}
+	};
+
+	// the overlapping triangle pairs come from traversing the BVH against itself, split into node pairs
+	// for the threads
+	_triangleBVH.selfPairTasks(_selfPairTasks, CONTACT_TASKS);
+	int numTasks = (int)_selfPairTasks.size();
+	_selfContactChunks.resize(numTasks);
+	parallelFor(0, numTasks, 1, [&](int taskBegin, int taskEnd)
+	{
+		for (int task = taskBegin; task < taskEnd; ++task)
+		{
+			std::vector<SelfContact>& chunk = _selfContactChunks[task];
+			chunk.clear();
+			_triangleBVH.selfPairs(_selfPairTasks[task], [&](int t, int u)
+			{
+				if (!_triangleBounds[t].overlaps(_triangleBounds[u]))
+					return;
+				testTriangles(t, u, chunk);
+				testTriangles(u, t, chunk);
+			});
+		}
+	});
+	_selfContacts.clear();
+	for (size_t c = 0; c < _selfContactChunks.size(); ++c)
+		_selfContacts.insert(_selfContacts.end(), _selfContactChunks[c].begin(), _selfContactChunks[c].end());
+
+	// contacts of every point, for gathering their corrections without write conflicts
+	int numPoints = points.size();
+	int numContacts = (int)_selfContacts.size();
+	_vertexContactOffsets.assign(numPoints + 1, 0);
+	for (int c = 0; c < numContacts; ++c)
+		for (int k = 0; k < 4; ++k)
+			_vertexContactOffsets[_selfContacts[c].vertex[k] + 1]++;
+	for (int i = 0; i < numPoints; ++i)
+		_vertexContactOffsets[i + 1] += _vertexContactOffsets[i];
+	_vertexContacts.resize(_vertexContactOffsets[numPoints]);
+	std::vector<int> slot(_vertexContactOffsets.begin(), _vertexContactOffsets.end() - 1);
+	for (int c = 0; c < numContacts; ++c)
+		for (int k = 0; k < 4; ++k)
+			_vertexContacts[slot[_selfContacts[c].vertex[k]]++] = 4 * c + k;
+	_selfContactScale.resize(numContacts);
+}
+
+void Cloth::findClothContacts(const Cloth& other, float thickness, std::vector<ContactPlane>& contacts,
+	std::vector<ContactPlane>& otherContacts) const
+{
+	_triangleBVH.queryPairs(other._triangleBVH, [&](int t, int u)
+	{
+		if (!_triangleBounds[t].overlaps(other._triangleBounds[u]))
+			return;
+		findPointContacts(t, other, u, thickness, contacts);
+		other.findPointContacts(u, *this, t, thickness, otherContacts);
+	});
+}
+
+void Cloth::findPointContacts(int t, const Cloth& other, int u, float thickness, std::vector<ContactPlane>& contacts) const
+{
+	const Vec3f* pos = points.pos.data();
+	const Vec3f* predPos = points.predPos.data();
+	const Vec3f* otherPos = other.points.pos.data();
+	const Vec3f* otherPredPos = other.points.predPos.data();
+	float radius = 1.5f * thickness;  // margin for the moves of the iterations
+	int a = other.indexArray[3 * u], b = other.indexArray[3 * u + 1], d = other.indexArray[3 * u + 2];
+
+	// a point is tested from the first triangle it belongs to, so each point-triangle pair comes up once
+	for (int k = 0; k < 3; ++k)
+	{
+		if (!(_triangleOwns[t] & (1 << k)))
+			continue;
+		int v = indexArray[3 * t + k];
+		AABB pointBox;
+		pointBox.expand(pos[v]);
+		pointBox.expand(predPos[v]);
+		pointBox.inflate(radius);
+		if (!pointBox.overlaps(other._triangleBounds[u]))
+			continue;
+		Vec3f closest = closestPointOnTriangle(predPos[v], otherPredPos[a], otherPredPos[b], otherPredPos[d]);
+		Vec3f end = predPos[v] - closest;
+		float endDist = mag(end);
+		float move = dist(pos[v], predPos[v]);
+		if (endDist >= radius + move)
+			continue;  // too far even for a crossing
+		Vec3f normal = cross(otherPos[b] - otherPos[a], otherPos[d] - otherPos[a]);
+		float area = mag(normal);
+		if (area <= M_EPSION)
+			continue;
+		// the plane of the triangle, facing the side the point started on
+		normal /= area;
+		if (dot(pos[v] - otherPos[a], normal) < 0.0f)
+			normal = -normal;
+		if (endDist >= radius && dot(end, normal) >= 0.0f)
+			continue;
+		ContactPlane contact;
+		contact.point = v;
+		contact.normal = normal;
+		contact.offset = dot(closest, normal) + thickness;
+		contact.velocity = Vec3f(0.0f);
+		contacts.push_back(contact);
+	}
+}
+
+void Cloth::projectTriangleContacts(float thickness)
+{
+	int numContacts = (int)_selfContacts.size();
+	if (numContacts == 0)
+		return;
+	Vec3f* predPos = points.predPos.data();
+	const float* invMass = points.invMass.data();
+	const SelfContact* contacts = _selfContacts.data();
+	float* scale = _selfContactScale.data();
+
+	// C = dot(sum_k weight[k] * x[k], normal) - thickness >= 0, with gradient weight[k] * normal for point k
+	parallelFor(0, numContacts, CONSTRAINT_GRAIN, [&](int begin, int end)
+	{
+		for (int c = begin; c < end; ++c)
+		{
+			const SelfContact& contact = contacts[c];
+			float C = -thickness;
+			float sumInvMass = 0.0f;
+			for (int k = 0; k < 4; ++k)
+			{
+				C += contact.weight[k] * dot(predPos[contact.vertex[k]], contact.normal);
+				sumInvMass += sqr(contact.weight[k]) * invMass[contact.vertex[k]];
+			}
+			scale[c] = C < 0.0f && sumInvMass > M_EPSION ? C / sumInvMass : 0.0f;
+		}
+	});
+
+	// every point averages the corrections of its active contacts
+	int numPoints = points.size();
+	parallelFor(0, numPoints, POINT_GRAIN, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			if (invMass[i] == 0)
+				continue;
+			Vec3f sum(0.0f);
+			int count = 0;
+			for (int n = _vertexContactOffsets[i]; n < _vertexContactOffsets[i + 1]; ++n)
+			{
+				int c = _vertexContacts[n] >> 2;
+				if (scale[c] == 0.0f)
+					continue;
+				sum -= contacts[c].normal * (scale[c] * contacts[c].weight[_vertexContacts[n] & 3]);
+				count++;
+			}
+			if (count > 0)
+				predPos[i] += sum * (invMass[i] / count);
+		}
+	});
+}
+
+void Cloth::sweepCollisions(float deltaTime)
+{
+	int numTilesX = tileCountX();
+	int numTiles = numTilesX * tileCountY();
+	const Vec3f* pos = points.pos.data();
+	Vec3f* predPos = points.predPos.data();
+	const float* invMass = points.invMass.data();
+	parallelFor(0, numTiles, 1, [&](int begin, int end)
 	{
-		// commit velosity based on position changes
-		this->points[i].vel = (points[i].predPos - points[i].pos) / deltaTime;
-		// printf("vel is %f\n", points[i].vel);
-		// commit position
-		this->points[i].pos = points[i].predPos;
-		/*if (i == 95)
-			printf("predPos x: %f, y: %f; currPos x: %f, y: %f; vel is %f\n", predPos[i][0], predPos[i][1], points[i].pos[0], points[i].pos[1], points[i].vel[1]);*/
+		for (int t = begin; t < end; ++t)
+		{
+			const std::vector<int>& tileColliders = _tileColliders[t];
+			if (tileColliders.empty())
+				continue;
+			int i0 = (t % numTilesX) * COLLISION_TILE;
+			int j0 = (t / numTilesX) * COLLISION_TILE;
+			for (int j = j0; j < min(j0 + COLLISION_TILE, resY); ++j)
+			{
+				for (int i = i0; i < min(i0 + COLLISION_TILE, resX); ++i)
+				{
+					int p = j * resX + i;
+					if (invMass[p] == 0)
+						continue;
+					// the tile bounds contain the whole move, so its colliders are the only ones it can hit
+					for (size_t c = 0; c < tileColliders.size(); ++c)
+						colliders->sweepPoint(pos[p], predPos[p], tileColliders[c], deltaTime);
+				}
+			}
+		}
+	});
+}
+
+float Cloth::projectDistanceIteration(float deltaTime)
+{
+	int numPoints = points.size();
+	int numColors = (int)constraintColorOffsets.size() - 1;
+	float residual = 0.0f;
+	if (solverType == JACOBI)
+	{
+		// every constraint reads the previous iterate, then every point averages its deltas
+		residual = parallelMax(0, (int)distConstraintList.size(), CONSTRAINT_GRAIN, [this](int begin, int end)
+		{
+			return computeJacobiDeltas(begin, end);
+		});
+		parallelFor(0, numPoints, POINT_GRAIN, [this](int begin, int end)
+		{
+			applyJacobiDeltas(begin, end);
+		});
+	}
+	else if (solverType == XPBD)
+	{
+		for (int c = 0; c < numColors; ++c)
+		{
+			residual = max(residual, parallelMax(constraintColorOffsets[c], constraintColorOffsets[c + 1], CONSTRAINT_GRAIN, [&](int begin, int end)
+			{
+				return projectXPBDConstraints(begin, end, deltaTime);
+			}));
+		}
+	}
+	else if (solverType == GRID_STENCIL)
+	{
+		// the same structural/shear constraints as createCloth, as 4 directions x 2 parities;
+		// within one half-sweep no two constraints share a point, so all rows run in parallel
+		float shearRestLength = sqrt(sizeX*sizeX + sizeY * sizeY);
+		const int directions[4][2] = { { 1, 0 }, { 0, 1 }, { 1, 1 }, { -1, 1 } };
+		const float rest[4] = { sizeX, sizeY, shearRestLength, shearRestLength };
+		for (int d = 0; d < 4; ++d)
+		{
+			for (int parity = 0; parity < 2; ++parity)
+			{
+				residual = max(residual, parallelMax(0, resY, max(1, CONSTRAINT_GRAIN / resX), [&](int rowBegin, int rowEnd)
+				{
+					return projectStencilRows(rowBegin, rowEnd, directions[d][0], directions[d][1], parity, rest[d]);
+				}));
+			}
+		}
+	}
+	else
+	{
+		// one color after the other, the constraints of a color in parallel
+		for (int c = 0; c < numColors; ++c)
+		{
+			residual = max(residual, parallelMax(constraintColorOffsets[c], constraintColorOffsets[c + 1], CONSTRAINT_GRAIN, [this](int begin, int end)
+			{
+				return projectDistanceConstraints(begin, end);
+			}));
+		}
+	}
+	return residual;
+}
+
+float Cloth::projectDistanceConstraints(int begin, int end)
+{
+	return _distanceKernel(points.predPos.data(), points.invMass.data(), distConstraintList.data(), restLength.data(), begin, end, k_stiff);
+}
+
+float Cloth::projectStencilRows(int rowBegin, int rowEnd, int dx, int dy, int parity, float rest)
+{
+	Vec3f* predPos = points.predPos.data();
+	const float* invMass = points.invMass.data();
+	int iBegin = dx < 0 ? 1 : 0;
+	int iEnd = dx > 0 ? resX - 1 : resX;
+	int iStep = dx == 0 ? 1 : 2;
+	if (dx != 0 && (iBegin & 1) != parity)
+		++iBegin;
+	int offset = dy * resX + dx;  // index distance to the neighbor
+	float invRest = 1 / rest;
+	float maxStretch = 0.0f;
+	for (int j = rowBegin; j < rowEnd; ++j)
+	{
+		if (j + dy >= resY || (dx == 0 && (j & 1) != parity))
+			continue;
+		for (int i = iBegin; i < iEnd; i += iStep)
+		{
+			int i1 = j * resX + i;
+			int i2 = i1 + offset;
+			float w1 = invMass[i1];
+			float w2 = invMass[i2];
+			float sumInvMass = w1 + w2;
+			if (sumInvMass <= M_EPSION)
+				continue;
+
+			Vec3f vecP2P1 = predPos[i1] - predPos[i2];
+			float magP2P1 = mag(vecP2P1);
+			if (magP2P1 <= M_EPSION)
+				continue;
+
+			float stretch = magP2P1 - rest;
+			maxStretch = max(maxStretch, std::fabs(stretch) * invRest);
+
+			// direction * scaler
+			Vec3f distProj = vecP2P1 * (stretch / (magP2P1 * sumInvMass) * k_stiff);
+			predPos[i1] -= distProj * w1;
+			predPos[i2] += distProj * w2;
+		}
+	}
+	return maxStretch;
+}
+
+float Cloth::computeJacobiDeltas(int begin, int end)
+{
+	const Vec3f* predPos = points.predPos.data();
+	const float* invMass = points.invMass.data();
+	const Vec2i* constraints = distConstraintList.data();
+	const float* rest = restLength.data();
+	Vec3f* delta = _constraintDelta.data();
+	float maxStretch = 0.0f;
+	for (int i = begin; i < end; ++i)
+	{
+		int i1 = constraints[i][0];
+		int i2 = constraints[i][1];
+		float sumInvMass = invMass[i1] + invMass[i2];
+		Vec3f vecP2P1 = predPos[i1] - predPos[i2];
+		float magP2P1 = mag(vecP2P1);
+		if (sumInvMass <= M_EPSION || magP2P1 <= M_EPSION)
+		{
+			delta[i] = Vec3f(0.0f);
+			continue;
+		}
+		float stretch = magP2P1 - rest[i];
+		maxStretch = max(maxStretch, std::fabs(stretch) / rest[i]);
+		delta[i] = vecP2P1 * (stretch / (magP2P1 * sumInvMass) * k_stiff);
+	}
+	return maxStretch;
+}
+
+void Cloth::applyJacobiDeltas(int begin, int end)
+{
+	Vec3f* predPos = points.predPos.data();
+	const float* invMass = points.invMass.data();
+	const int* offsets = _pointConstraintOffsets.data();
+	const int* adjacent = _pointConstraints.data();
+	const Vec3f* delta = _constraintDelta.data();
+	for (int i = begin; i < end; ++i)
+	{
+		int count = offsets[i + 1] - offsets[i];
+		if (invMass[i] == 0 || count == 0)
+			continue;
+		Vec3f sum(0.0f);
+		for (int k = offsets[i]; k < offsets[i + 1]; ++k)
+		{
+			// the first point of a constraint moves against the delta, the second one along it
+			if (adjacent[k] & 1)
+				sum += delta[adjacent[k] >> 1];
+			else
+				sum -= delta[adjacent[k] >> 1];
+		}
+		predPos[i] += sum * (invMass[i] * jacobiRelaxation / count);
+	}
+}
+
+void Cloth::warmStartXPBD(int begin, int end, float lambdaScale)
+{
+	Vec3f* predPos = points.predPos.data();
+	const float* invMass = points.invMass.data();
+	const Vec2i* constraints = distConstraintList.data();
+	const float* alpha = compliance.data();
+	float* lambda = _lambda.data();
+	for (int i = begin; i < end; ++i)
+	{
+		// carry over tension only; without compliance nothing bounds lambda against the warm start correction
+		lambda[i] = alpha[i] > 0.0f ? min(lambda[i] * lambdaScale, 0.0f) : 0.0f;
+		if (lambda[i] == 0.0f)
+			continue;
+		int i1 = constraints[i][0];
+		int i2 = constraints[i][1];
+		Vec3f vecP2P1 = predPos[i1] - predPos[i2];
+		float magP2P1 = mag(vecP2P1);
+		if (magP2P1 <= M_EPSION)
+			continue;
+		// the correction the multiplier stands for, along the current constraint direction
+		Vec3f n_val = vecP2P1 * (lambda[i] / magP2P1);
+		predPos[i1] += n_val * invMass[i1];
+		predPos[i2] -= n_val * invMass[i2];
+	}
+}
+
+float Cloth::projectXPBDConstraints(int begin, int end, float deltaTime)
+{
+	Vec3f* predPos = points.predPos.data();
+	const float* invMass = points.invMass.data();
+	const Vec2i* constraints = distConstraintList.data();
+	const float* rest = restLength.data();
+	const float* alpha = compliance.data();
+	float* lambda = _lambda.data();
+	float invDeltaTime2 = 1 / (deltaTime * deltaTime);
+	float maxStretch = 0.0f;
+	for (int i = begin; i < end; ++i)
+	{
+		int i1 = constraints[i][0];
+		int i2 = constraints[i][1];
+		float w1 = invMass[i1];
+		float w2 = invMass[i2];
+		float alphaTilde = alpha[i] * invDeltaTime2;  // time step scaled compliance
+		float denom = w1 + w2 + alphaTilde;
+		if (denom <= M_EPSION)
+			continue;
+
+		Vec3f vecP2P1 = predPos[i1] - predPos[i2];
+		float magP2P1 = mag(vecP2P1);
+		if (magP2P1 <= M_EPSION)
+			continue;
+
+		maxStretch = max(maxStretch, std::fabs(magP2P1 - rest[i]) / rest[i]);
+
+		// delta lambda = (-C - alphaTilde * lambda) / (w1 + w2 + alphaTilde)
+		float deltaLambda = (rest[i] - magP2P1 - alphaTilde * lambda[i]) / denom;
+		lambda[i] += deltaLambda;
+		Vec3f n_val = vecP2P1 * (deltaLambda / magP2P1);
+		predPos[i1] += n_val * w1;
+		predPos[i2] -= n_val * w2;
 	}
+	return maxStretch;
 }
 
 void Cloth::setPositionConstraint()
 {
 	// top left point = first point in last row
 	int tlIndex = resX * (resY - 1);
-	this->points[tlIndex].pos = _posConstraintList[0];
+	this->points.pos[tlIndex] = _posConstraintList[0];
 	// top right point = last point in last row
 	int trIndex = (resX * resY) - 1;
-	this->points[trIndex].pos = _posConstraintList[1];
+	this->points.pos[trIndex] = _posConstraintList[1];
 }
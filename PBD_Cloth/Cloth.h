@@ -5,57 +5,232 @@
 #include <math.h>
 #include <string>
 #include <iostream>
+#include <memory>
 #include "Vec.h"
-#include "Shader.h"
-#include <glad/glad.h>
-#include <GLFW/glfw3.h>
+#include "ThreadPool.h"
+#include "ConstraintKernels.h"
+#include "Collider.h"
+#include "SpatialHash.h"
+#include "BVH.h"
 
 #define DEBUG_ID 
 
 class Cloth
 {
 public:
-	struct Point
+	// structure-of-arrays storage of the cloth points: the solver loops only stream the arrays they touch
+	struct Particles
 	{
-		Vec3f pos; // position of the point
-		Vec3f predPos;  // predicted position stored here in update process
-		Vec3f vel; // velocity of the point
-		Vec3f accel; // acceleration of the point
-		float mass;
+		std::vector<Vec3f> pos; // position of the point
+		std::vector<Vec3f> predPos;  // predicted position stored here in update process
+		std::vector<Vec3f> vel; // velocity of the point
+		std::vector<float> invMass;  // precomputed 1 / mass; 0 for fixed points
+
+		int size() const { return (int)pos.size(); }
+		void reserve(int n) { pos.reserve(n); predPos.reserve(n); vel.reserve(n); invMass.reserve(n); }
+		void push_back(const Vec3f& newPos, const Vec3f& newVel, float newInvMass)
+		{
+			pos.push_back(newPos);
+			predPos.push_back(newPos);
+			vel.push_back(newVel);
+			invMass.push_back(newInvMass);
+		}
+	};
+
+	enum SolverType
+	{
+		GAUSS_SEIDEL,  // constraints update predPos in place, one color batch after the other
+		JACOBI,  // constraints read the previous iterate and write deltas that are averaged per point
+		XPBD,  // Gauss-Seidel on compliant constraints with Lagrange multipliers; ignores k_stiff
+		GRID_STENCIL  // Gauss-Seidel that walks the grid neighbors from the stencil instead of reading distConstraintList;
+		              // the lists are still built for the other solvers, so this saves no memory (and is slower than GAUSS_SEIDEL)
 	};
 
 	int resX, resY;  // # of points on each width and height
 	float sizeX, sizeY;  // size of the length between each two points (could be used to initialize the restLength)
 	float k_stiff;  // stiffness of the distance constraint
+	SolverType solverType = GAUSS_SEIDEL;
+	float jacobiRelaxation = 1.0f;  // scales the averaged Jacobi deltas; < 1 under-relaxes, up to ~1.5 over-relaxes
+	int coarseIterations = 4;  // iterations spent on each coarse level per substep, see setHierarchyLevels
+	float residualTolerance = 0.0f;  // stop iterating once the largest relative stretch drops below this; 0: always solverIter
+	bool chebyshev = false;  // Chebyshev semi-iterative acceleration of the solver iterations
+	float chebyshevRho = 0.0f;  // spectral radius used for the acceleration; <= 0 estimates it from the residuals
+	int chebyshevDelay = 2;  // plain iterations before the acceleration starts; the first iteration is always plain
+	// fraction of the previous substep's tension multipliers the XPBD solve starts from; 1 may overshoot. Only
+	// constraints with compliance > 0 are warm started, so with the default inextensible material it does nothing
+	float xpbdWarmStart = 0.8f;
 	bool hasPosConstr;
 	Vec3f initPos;  // init pos in the world coordinate
-	std::vector<Point> points; // the points that constructs the piece of cloth
+	Particles points; // the points that constructs the piece of cloth
 	std::vector<Vec2i> distConstraintList;  // containing the distance constrains between the edges
 	std::vector<float> restLength; // the rest lengths between each two points of the cloth
-	std::vector<GLuint> indexArray;  // for drawing the cloth grid
+	std::vector<float> compliance;  // XPBD: inverse stiffness of each distance constraint (0: inextensible)
+	std::vector<int> constraintColorOffsets;  // constraints of color c are [offsets[c], offsets[c+1]) and share no points
+	std::vector<unsigned int> indexArray;  // for drawing the cloth grid
+	std::shared_ptr<ColliderSet> colliders;  // solids the points are kept out of; NULL: no collisions
+	bool continuousCollision = false;  // sweep pos -> predPos against the colliders each substep, so fast points cannot tunnel
+	bool selfCollision = false;  // keep points that are not connected by a constraint selfCollisionThickness apart
+	bool triangleSelfCollision = false;  // vertex-triangle and edge-edge contacts between the triangles of indexArray
+	float selfCollisionThickness = 0.0f;  // of selfCollision; <= 0: half the smaller grid spacing
+	float triangleCollisionThickness = 0.0f;  // of triangleSelfCollision; <= 0: half the smaller grid spacing
+	float contactMargin = 0.0f;  // colliders closer than this to a predicted point become its contacts; <= 0: half the larger grid spacing
+	float friction = 0.0f;  // Coulomb friction of points pressed onto colliders, against their slip relative to the collider surface
 
-	GLuint _vertexBuffer;
-	GLuint _indexBuffer;
-
-	Cloth() {}
+	Cloth() { setKernelISA(detectKernelISA()); }
 	~Cloth() {};
-	Cloth(int resX, int resY, float sizeX, float sizeY, float k_stiff, bool hasPosConstr, Vec3f initPos)
+	Cloth(int resX, int resY, float sizeX, float sizeY, float k_stiff, bool hasPosConstr, Vec3f initPos, int numThreads = 0)
 		: resX(resX), resY(resY), sizeX(sizeX), sizeY(sizeY), k_stiff(k_stiff), hasPosConstr(hasPosConstr), initPos(initPos){
 		init();
+		setThreadCount(numThreads);
+		setKernelISA(detectKernelISA());
 	}
-	void update(float deltaTime, float dampingRate, bool hasPosConstr, int solverIter, Vec3f sphereCenter, float sphereRadius); // change the positions and velosities of each point
+	void setThreadCount(int numThreads);  // threads of its own; 1: solve serially; 0: one thread per hardware core
+	void setThreadPool(ThreadPool* pool);  // solve on the caller's threads, shared with other work; NULL: serially
+	int threadCount() const { return _threadPool ? _threadPool->size() : 1; }
+	void setKernelISA(KernelISA isa);  // instruction set of the Gauss-Seidel batch kernel; unsupported ones fall back
+	KernelISA kernelISA() const { return _kernelISA; }
+	void setCompliance(float structural, float shear);  // XPBD material, independent of time step and iterations
+	// coarse-to-fine solve: level l keeps every 2^(l+1)-th row and column of the grid with its own distance constraints;
+	// each substep solves the coarsest level first and interpolates its corrections down before the fine iterations
+	void setHierarchyLevels(int numLevels);  // 0: fine grid only
+	int hierarchyLevels() const { return (int)_levels.size(); }
+	float spectralRadiusEstimate() const { return _rhoEstimate; }
+	int lastIterationCount() const { return _lastIterationCount; }  // solver iterations the last update used
+	float lastResidual() const { return _lastResidual; }  // largest relative stretch seen in the last iteration of the last update
+	void update(float deltaTime, float dampingRate, bool hasPosConstr, int solverIter); // change the positions and velosities of each point
+	// the two halves of update(), for scenes that couple several cloths between them
+	void predict(float deltaTime, float dampingRate);  // external forces and the predicted positions
+	void solve(float deltaTime, bool hasPosConstr, int solverIter);  // constraints and collisions, then commit
+	// contacts with other cloths found between predict() and solve(); the next solve() projects and clears them
+	std::vector<ContactPlane> externalContacts;
+	const AABB& sweptBounds() const { return _sweptBounds; }  // of all points from pos to predPos, as of the last predict()
+	// refit the BVH over the triangles swept from pos to predPos, thickened by margin
+	void updateTriangleBVH(float margin);
+	const BVH& triangleBVH() const { return _triangleBVH; }
+	// append the contacts of this cloth's points with the triangles of other, and the other way around, that are
+	// closer than 1.5 thickness at predPos or were crossed during the substep; both BVHs have to be up to date
+	void findClothContacts(const Cloth& other, float thickness, std::vector<ContactPlane>& contacts,
+		std::vector<ContactPlane>& otherContacts) const;
 	// void save(std::string path);  // store the object to the hard disk
 	// void bindBuffers();
 	// void render(Shader myShader, glm::mat4 model, glm::mat4 view, glm::mat4 projection);
 
 private:
+	// a coarse level of the hierarchy; its constraints connect the fine points it keeps
+	struct Level
+	{
+		std::vector<int> cols, rows;  // fine grid columns/rows kept on this level (multiples of the stride and the last one)
+		std::vector<int> pointIndex;  // fine index of each coarse point, row major over rows x cols
+		std::vector<Vec2i> constraints;  // structural and shear constraints between neighboring coarse points
+		std::vector<float> restLength;
+		std::vector<int> colorOffsets;
+		std::vector<int> colCell, rowCell;  // fine column/row -> coarse interval it is interpolated from
+		std::vector<float> colFrac, rowFrac;  // interpolation weight of the upper end of that interval
+		std::vector<Vec3f> startPos;  // predPos of the coarse points before the level is solved
+	};
+
 	std::vector<Vec3f> _posConstraintList;  // stores the position of position contraints
+	std::vector<int> _pointConstraintOffsets;  // constraints touching point i are _pointConstraints[offsets[i], offsets[i+1])
+	std::vector<int> _pointConstraints;  // constraint index * 2 + which end of the constraint the point is
+	std::vector<int> _pointNeighbors;  // the other end of each of _pointConstraints
+	std::vector<Vec3f> _constraintDelta;  // Jacobi: correction of each constraint, before the inverse mass weighting
+	std::vector<float> _lambda;  // XPBD: Lagrange multiplier of each distance constraint, kept across substeps
+	float _lambdaDeltaTime = 0.0f;  // XPBD: time step the multipliers in _lambda were accumulated with
+	std::vector<Level> _levels;  // coarse levels, finest first
+	SpatialHash _selfCollisionHash;  // predPos at the start of the substep's iterations
+	std::vector<int> _selfCollisionOffsets;  // candidates of point i are _selfCollisionCandidates[offsets[i], offsets[i+1])
+	std::vector<int> _selfCollisionCandidates;
+	std::vector<std::vector<int> > _selfCollisionChunks;  // candidates found by each task, before concatenation
+	std::vector<Vec3f> _selfCollisionDelta;
+	// triangle self-collision contact: sum_k weight[k] * predPos[vertex[k]] is the separation vector of the closest
+	// points, kept at least the thickness long along normal (pointing to the side the contact started on)
+	struct SelfContact
+	{
+		int vertex[4];
+		float weight[4];
+		Vec3f normal;
+	};
+	AABB _sweptBounds;
+	BVH _triangleBVH;  // over the swept and thickened triangles, refit every substep
+	std::vector<AABB> _triangleBounds;
+	std::vector<AABB> _edgeBounds;
+	std::vector<Vec2i> _edges;  // unique edges of indexArray
+	std::vector<Vec3i> _triangleEdges;  // the edges of each triangle of indexArray
+	std::vector<unsigned char> _triangleOwns;  // bit k: first triangle of its point k, bit 3 + k: of its edge k
+	std::vector<SelfContact> _selfContacts;
+	std::vector<Vec2i> _selfPairTasks;  // node pairs of _triangleBVH searched by one task each
+	std::vector<std::vector<SelfContact> > _selfContactChunks;  // contacts found by each task, before concatenation
+	std::vector<int> _vertexContactOffsets;  // contacts of point i are _vertexContacts[offsets[i], offsets[i+1])
+	std::vector<int> _vertexContacts;  // contact index * 4 + slot of the point in the contact
+	std::vector<float> _selfContactScale;
+	std::vector<std::vector<int> > _tileColliders;  // colliders that may reach each tile during the current substep
+	// collider contacts found once per substep, the iterations keep dot(predPos[point], normal) >= offset
+	std::vector<std::vector<ContactPlane> > _tileContacts;  // contacts of the points of each tile, in point order
+	std::vector<int> _externalOffsets;  // externalContacts of point i are [offsets[i], offsets[i+1]) after sorting
+	std::vector<Vec3f> _chebyshevIterate[2];  // Chebyshev: the two previous iterates of predPos
+	int _lastIterationCount = 0;
+	float _lastResidual = 0.0f;
+	float _rhoEstimate = 0.0f;  // Chebyshev: spectral radius learned from the residuals, kept across substeps
+	KernelISA _kernelISA;
+	DistanceKernel _distanceKernel;
+	std::shared_ptr<ThreadPool> _ownThreadPool;  // made by setThreadCount(); shared by copies of the cloth
+	ThreadPool* _threadPool = NULL;  // _ownThreadPool or the caller's; NULL when solving serially
 
 	void init();  // initialize the restLength
-	bool isInside(int x, int y) { return x >= 0 && y >= 0 && x < resX && y < resX; } // check whether the current checking point is inside the grid
+	bool isInside(int x, int y) { return x >= 0 && y >= 0 && x < resX && y < resY; } // check whether the current checking point is inside the grid
 	int Vec2iToInt(int p0, int p1) { return p1 * resX + p0; }  // change from vec2i of constraint to grid point index
 	void createCloth(int resX, int resY, float sizeX, float sizeY, bool hasPosConstr);
 	void initIndexArray();
+	// sort constraints (and their rest lengths) into batches of constraints that share no points
+	static void colorConstraints(int numPoints, std::vector<Vec2i>& constraints, std::vector<float>& restLength, std::vector<int>& colorOffsets);
+	void solveLevel(Level& level);  // project a coarse level and interpolate its corrections to the fine grid
+	void buildPointAdjacency();  // constraints touching each point, for gathering Jacobi deltas
+	// one sweep over the distance constraints with the current solver; returns the largest relative stretch it saw
+	float projectDistanceIteration(float deltaTime);
+	float projectDistanceConstraints(int begin, int end);  // Gauss-Seidel over constraints [begin, end)
+	float computeJacobiDeltas(int begin, int end);  // Jacobi: constraints [begin, end) against the previous iterate
+	void applyJacobiDeltas(int begin, int end);  // Jacobi: average the deltas of points [begin, end)
+	void warmStartXPBD(int begin, int end, float lambdaScale);  // XPBD: apply the scaled multipliers of constraints [begin, end)
+	float projectXPBDConstraints(int begin, int end, float deltaTime);  // XPBD: Gauss-Seidel over constraints [begin, end)
+	// stencil: constraints from rows [rowBegin, rowEnd) to their (dx, dy) neighbor whose start column (or row if dx == 0) has the given parity
+	float projectStencilRows(int rowBegin, int rowEnd, int dx, int dy, int parity, float rest);
+	template<class F>
+	void parallelFor(int begin, int end, int grainSize, const F& func)
+	{
+		if (_threadPool)
+			_threadPool->parallelFor(begin, end, grainSize, func);
+		else
+			func(begin, end);
+	}
+	template<class F>
+	float parallelMax(int begin, int end, int grainSize, const F& func)
+	{
+		if (_threadPool)
+			return _threadPool->parallelReduce(begin, end, grainSize, 0.0f, func, [](float a, float b) { return max(a, b); });
+		return func(begin, end);
+	}
+	// collision culling: the grid is split into square tiles of points, and each tile only tests the colliders
+	// overlapping its bounds for this substep; most tiles of a large cloth test none
+	int tileCountX() const;
+	int tileCountY() const;
+	void cullCollisionTiles(float margin);  // fill _tileColliders from pos and predPos
+	void findCollisionContacts(float margin);  // fill _tileContacts once per substep
+	void projectCollisions(float deltaTime);  // project the cached contacts
+	void projectExternalContacts();
+	// contacts of the points owned by triangle t with the triangle u of other
+	void findPointContacts(int t, const Cloth& other, int u, float thickness, std::vector<ContactPlane>& contacts) const;
+	void sweepCollisions(float deltaTime);  // continuous collision of the predicted moves, tile by tile
+	bool isConnected(int p1, int p2) const;  // true if a distance constraint joins the two points
+	// self-collision: once per substep the spatial hash collects the unconnected points within radius of each point;
+	// the iterations then only look at these candidates
+	void findSelfCollisionCandidates(float radius);
+	// Jacobi-style: every point averages the pushes away from its close candidates, then all move at once
+	void projectSelfCollisions(float thickness);
+	void initTriangleEdges();
+	// triangle self-collision: once per substep the BVH gathers the vertex-triangle and edge-edge pairs closer than
+	// 1.5 thickness or crossing during the substep; the iterations only project these contacts
+	void findTriangleContacts(float thickness);
+	void projectTriangleContacts(float thickness);
 	void setPositionConstraint(); // only used in single cloth mode to check updating
 };
 
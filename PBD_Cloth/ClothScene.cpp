@@ -0,0 +1,84 @@
+#include "ClothScene.h"
+
+ClothScene::ClothScene(ThreadPool* pool)
+	: _threadPool(pool)
+{
+}
+
+int ClothScene::add(std::shared_ptr<Cloth> cloth)
+{
+	if (_threadPool)
+		cloth->setThreadPool(_threadPool);
+	_cloths.push_back(cloth);
+	return (int)_cloths.size() - 1;
+}
+
+void ClothScene::update(float deltaTime, float dampingRate, bool hasPosConstr, int solverIter)
+{
+	int numCloths = size();
+	for (int i = 0; i < numCloths; ++i)
+		_cloths[i]->predict(deltaTime, dampingRate);
+
+	_pairs.clear();
+	_lastContactCount = 0;
+	if (numCloths > 1)
+	{
+		float sceneThickness = thickness;
+		if (sceneThickness <= 0.0f)
+		{
+			sceneThickness = 1e30f;
+			for (int i = 0; i < numCloths; ++i)
+				sceneThickness = min(sceneThickness, 0.5f * min(_cloths[i]->sizeX, _cloths[i]->sizeY));
+		}
+		// broadphase on the whole cloths, with their swept boxes thickened like the triangle boxes below: by half
+		// the contact radius, so all pairs closer than it overlap
+		float margin = 0.75f * sceneThickness;
+		for (int i = 0; i < numCloths; ++i)
+		{
+			AABB box = _cloths[i]->sweptBounds();
+			box.inflate(margin);
+			for (int j = i + 1; j < numCloths; ++j)
+			{
+				AABB other = _cloths[j]->sweptBounds();
+				other.inflate(margin);
+				if (box.overlaps(other))
+					_pairs.push_back(Vec2i(i, j));
+			}
+		}
+
+		// then the BVHs of the overlapping ones against each other; only they need their BVHs refit
+		_inPair.assign(numCloths, 0);
+		for (size_t p = 0; p < _pairs.size(); ++p)
+			_inPair[_pairs[p][0]] = _inPair[_pairs[p][1]] = 1;
+		for (int i = 0; i < numCloths; ++i)
+			if (_inPair[i])
+				_cloths[i]->updateTriangleBVH(margin);
+
+		int numPairs = (int)_pairs.size();
+		_pairContacts.resize(2 * numPairs);
+		auto findContacts = [&](int begin, int end)
+		{
+			for (int p = begin; p < end; ++p)
+			{
+				_pairContacts[2 * p].clear();
+				_pairContacts[2 * p + 1].clear();
+				_cloths[_pairs[p][0]]->findClothContacts(*_cloths[_pairs[p][1]], sceneThickness, _pairContacts[2 * p],
+					_pairContacts[2 * p + 1]);
+			}
+		};
+		if (_threadPool)
+			_threadPool->parallelFor(0, numPairs, 1, findContacts);
+		else
+			findContacts(0, numPairs);
+
+		for (int p = 0; p < 2 * numPairs; ++p)
+		{
+			std::vector<ContactPlane>& contacts = _cloths[_pairs[p / 2][p % 2]]->externalContacts;
+			contacts.insert(contacts.end(), _pairContacts[p].begin(), _pairContacts[p].end());
+			_lastContactCount += (int)_pairContacts[p].size();
+		}
+	}
+
+	for (int i = 0; i < numCloths; ++i)
+		_cloths[i]->solve(deltaTime, hasPosConstr, solverIter);
+}
@@ -0,0 +1,36 @@
+#ifndef CLOTHSCENE_H
+#define CLOTHSCENE_H
+
+#include <memory>
+#include <vector>
+#include "Cloth.h"
+#include "ThreadPool.h"
+
+// Several cloths stepped together and kept apart from each other.
+// Each substep predicts every cloth and finds the contacts between the cloths: only pairs whose swept bounds
+// overlap get their BVHs refit and traversed BVH against BVH, each pair as its own task giving the contacts of
+// both cloths' points with the other's triangles. Every cloth then solves with the planes of its contacts.
+// The cloths and the contact search all run on the scene's threads.
+class ClothScene
+{
+public:
+	float thickness = 0.0f;  // distance kept between the cloths; <= 0: half the smallest grid spacing of all cloths
+
+	explicit ClothScene(ThreadPool* pool = NULL);  // the caller's threads; NULL: serial
+	int add(std::shared_ptr<Cloth> cloth);  // moves the cloth onto the scene's threads; returns its index
+	int size() const { return (int)_cloths.size(); }
+	Cloth& operator[](int i) { return *_cloths[i]; }
+	const Cloth& operator[](int i) const { return *_cloths[i]; }
+	void update(float deltaTime, float dampingRate, bool hasPosConstr, int solverIter);
+	int lastContactCount() const { return _lastContactCount; }  // contacts between the cloths in the last update
+
+private:
+	std::vector<std::shared_ptr<Cloth> > _cloths;
+	ThreadPool* _threadPool;
+	std::vector<Vec2i> _pairs;  // cloths with overlapping bounds in the current substep
+	std::vector<char> _inPair;  // cloth i is in any of _pairs
+	std::vector<std::vector<ContactPlane> > _pairContacts;  // contacts of the first and of the second cloth of each pair
+	int _lastContactCount = 0;
+};
+
+#endif
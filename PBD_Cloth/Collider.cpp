@@ -0,0 +1,323 @@
+#include "Collider.h"
+
+// upper bound on the broadphase cells; the cell size grows until the grid fits
+static const int MAX_GRID_CELLS = 1 << 18;
+// conservative advancement: steps before giving up, and the distance that counts as touching the surface
+static const int MAX_MARCH_STEPS = 32;
+static const float MARCH_HIT_DISTANCE = 1e-4f;
+
+
+bool Collider::raycast(const Vec3f& from, const Vec3f& to, float& t, Vec3f& normal) const
+{
+	Vec3f dir = to - from;
+	float len = mag(dir);
+	float dist = signedDistance(from, normal);
+	if (dist < 0.0f)
+		return false;
+	if (len <= M_EPSION)
+		return false;
+	// the surface is at least dist away, so the segment can safely advance that far
+	t = 0.0f;
+	for (int step = 0; step < MAX_MARCH_STEPS && t <= 1.0f; ++step)
+	{
+		if (dist < MARCH_HIT_DISTANCE)
+			return true;
+		t += dist / len;
+		dist = signedDistance(from + dir * min(t, 1.0f), normal);
+	}
+	if (dist < MARCH_HIT_DISTANCE)
+	{
+		t = min(t, 1.0f);
+		return true;
+	}
+	return false;
+}
+
+AABB SphereCollider::bounds() const
+{
+	return AABB(center - Vec3f(radius), center + Vec3f(radius));
+}
+
+float SphereCollider::signedDistance(const Vec3f& p, Vec3f& normal) const
+{
+	Vec3f p2c = p - center;
+	float dist = mag(p2c);
+	if (dist > M_EPSION)
+		normal = p2c / dist;
+	else
+		normal = Vec3f(0.0f, 1.0f, 0.0f);  // at the center any direction is the shortest way out
+	return dist - radius;
+}
+
+bool SphereCollider::raycast(const Vec3f& from, const Vec3f& to, float& t, Vec3f& normal) const
+{
+	// |from + dir * t - center| = radius
+	Vec3f dir = to - from;
+	Vec3f c2f = from - center;
+	float a = mag2(dir);
+	float b = dot(c2f, dir);
+	float c = mag2(c2f) - radius * radius;
+	if (c < 0.0f || b >= 0.0f || a <= M_EPSION)
+		return false;  // inside already, or moving away
+	float discriminant = b * b - a * c;
+	if (discriminant < 0.0f)
+		return false;
+	t = (-b - sqrt(discriminant)) / a;
+	if (t > 1.0f)
+		return false;
+	normal = normalized(c2f + dir * t);
+	return true;
+}
+
+AABB CapsuleCollider::bounds() const
+{
+	return AABB(min_union(a, b) - Vec3f(radius), max_union(a, b) + Vec3f(radius));
+}
+
+float CapsuleCollider::signedDistance(const Vec3f& p, Vec3f& normal) const
+{
+	// closest point on the segment
+	Vec3f ab = b - a;
+	float len2 = mag2(ab);
+	float t = len2 > M_EPSION ? clamp(dot(p - a, ab) / len2, 0.0f, 1.0f) : 0.0f;
+	Vec3f p2c = p - (a + ab * t);
+	float dist = mag(p2c);
+	if (dist > M_EPSION)
+		normal = p2c / dist;
+	else
+		normal = Vec3f(0.0f, 1.0f, 0.0f);
+	return dist - radius;
+}
+
+float PlaneCollider::signedDistance(const Vec3f& p, Vec3f& outNormal) const
+{
+	outNormal = normal;
+	return dot(p - point, normal);
+}
+
+bool PlaneCollider::raycast(const Vec3f& from, const Vec3f& to, float& t, Vec3f& outNormal) const
+{
+	float d0 = dot(from - point, normal);
+	float d1 = dot(to - point, normal);
+	if (d0 < 0.0f || d1 >= 0.0f)
+		return false;
+	t = d0 / (d0 - d1);
+	outNormal = normal;
+	return true;
+}
+
+float BoxCollider::signedDistance(const Vec3f& p, Vec3f& normal) const
+{
+	Vec3f local = p - center;
+	Vec3f q;  // distance outside each slab, negative inside
+	for (int k = 0; k < 3; ++k)
+		q[k] = std::fabs(local[k]) - halfExtents[k];
+
+	if (q[0] > 0.0f || q[1] > 0.0f || q[2] > 0.0f)
+	{
+		// outside: distance to the closest point of the box
+		Vec3f out;
+		for (int k = 0; k < 3; ++k)
+			out[k] = q[k] > 0.0f ? (local[k] < 0.0f ? -q[k] : q[k]) : 0.0f;
+		float dist = mag(out);
+		normal = out / dist;
+		return dist;
+	}
+
+	// inside: leave through the closest face
+	int axis = 0;
+	if (q[1] > q[axis]) axis = 1;
+	if (q[2] > q[axis]) axis = 2;
+	normal = Vec3f(0.0f);
+	normal[axis] = local[axis] < 0.0f ? -1.0f : 1.0f;
+	return q[axis];
+}
+
+int ColliderSet::add(std::shared_ptr<Collider> collider)
+{
+	_colliders.push_back(collider);
+	_built = false;
+	return (int)_colliders.size() - 1;
+}
+
+void ColliderSet::clear()
+{
+	_colliders.clear();
+	_built = false;
+}
+
+void ColliderSet::build()
+{
+	int numColliders = size();
+	_bounds.resize(numColliders);
+	_unbounded.clear();
+	_gridBounds = AABB();
+	float sumExtent = 0.0f;
+	int numBounded = 0;
+	for (int i = 0; i < numColliders; ++i)
+	{
+		if (!_colliders[i]->bounded())
+		{
+			_unbounded.push_back(i);
+			continue;
+		}
+		_bounds[i] = _colliders[i]->bounds();
+		_gridBounds.expand(_bounds[i]);
+		sumExtent += max(_bounds[i].hi - _bounds[i].lo);
+		numBounded++;
+	}
+	_built = true;
+	_cellOffsets.assign(1, 0);
+	_cellColliders.clear();
+	_dims[0] = _dims[1] = _dims[2] = 0;
+	if (numBounded == 0)
+		return;
+
+	// cells about the size of an average collider, so each collider overlaps a few cells
+	Vec3f extent = _gridBounds.hi - _gridBounds.lo;
+	float cell = cellSize > 0.0f ? cellSize : sumExtent / numBounded;
+	cell = max(cell, max(extent) * 1e-4f, M_EPSION);
+	for (;;)
+	{
+		long long numCells = 1;
+		for (int k = 0; k < 3; ++k)
+		{
+			_dims[k] = max(1, (int)std::ceil(extent[k] / cell));
+			numCells *= _dims[k];
+		}
+		if (numCells <= MAX_GRID_CELLS)
+			break;
+		cell *= 1.5f;
+	}
+	_invCellSize = 1 / cell;
+
+	// counting sort of the collider ids into the cells they overlap
+	int numCells = _dims[0] * _dims[1] * _dims[2];
+	_cellOffsets.assign(numCells + 1, 0);
+	int lo[3], hi[3];
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		std::vector<int> slot;
+		if (pass == 1)
+		{
+			for (int c = 0; c < numCells; ++c)
+				_cellOffsets[c + 1] += _cellOffsets[c];
+			_cellColliders.resize(_cellOffsets[numCells]);
+			slot.assign(_cellOffsets.begin(), _cellOffsets.end() - 1);
+		}
+		for (int i = 0; i < numColliders; ++i)
+		{
+			if (!_colliders[i]->bounded())
+				continue;
+			cellRange(_bounds[i], lo, hi);
+			for (int z = lo[2]; z <= hi[2]; ++z)
+				for (int y = lo[1]; y <= hi[1]; ++y)
+					for (int x = lo[0]; x <= hi[0]; ++x)
+					{
+						int c = (z * _dims[1] + y) * _dims[0] + x;
+						if (pass == 0)
+							_cellOffsets[c + 1]++;
+						else
+							_cellColliders[slot[c]++] = i;
+					}
+		}
+	}
+}
+
+void ColliderSet::cellRange(const AABB& box, int lo[3], int hi[3]) const
+{
+	for (int k = 0; k < 3; ++k)
+	{
+		lo[k] = clamp((int)std::floor((box.lo[k] - _gridBounds.lo[k]) * _invCellSize), 0, _dims[k] - 1);
+		hi[k] = clamp((int)std::floor((box.hi[k] - _gridBounds.lo[k]) * _invCellSize), 0, _dims[k] - 1);
+	}
+}
+
+bool ColliderSet::projectPoint(Vec3f& p, int collider) const
+{
+	Vec3f normal;
+	float dist = _colliders[collider]->signedDistance(p, normal);
+	if (dist >= M_EPSION)
+		return false;
+	p -= normal * dist;  // onto the surface along the normal
+	return true;
+}
+
+bool ColliderSet::contactPlane(const Vec3f& p, int collider, float margin, Vec3f& normal, float& offset, Vec3f& velocity) const
+{
+	float dist = _colliders[collider]->contactDistance(p, margin, normal, velocity);
+	if (dist >= margin || mag2(normal) == 0.0f)
+		return false;  // too far, or no direction to push out along or to rub against
+	offset = dot(p, normal) - dist;  // through the closest surface point
+	return true;
+}
+
+bool ColliderSet::sweepPoint(const Vec3f& from, Vec3f& to, int collider, float deltaTime) const
+{
+	AABB path;
+	path.expand(from);
+	path.expand(to);
+	if (_colliders[collider]->bounded() && !path.overlaps(_bounds[collider]))
+		return false;  // the bounds of a moving collider cover all of its motion
+	Vec3f start = from;
+	if (deltaTime > 0.0f)
+		start += _colliders[collider]->velocity(from) * deltaTime;
+	float t;
+	Vec3f normal;
+	if (!_colliders[collider]->raycast(start, to, t, normal))
+		return false;
+	// slide: the part of the move after the hit loses its component into the surface
+	Vec3f hit = start + (to - start) * t;
+	Vec3f rest = to - hit;
+	to = hit + rest - normal * min(dot(rest, normal), 0.0f);
+	return true;
+}
+
+bool ColliderSet::projectPoint(Vec3f& p) const
+{
+	assert(_built);
+	bool moved = false;
+	for (size_t u = 0; u < _unbounded.size(); ++u)
+		moved |= projectPoint(p, _unbounded[u]);
+	if (_cellColliders.empty() || !_gridBounds.contains(p))
+		return moved;
+
+	int cell[3];
+	for (int k = 0; k < 3; ++k)
+		cell[k] = min((int)((p[k] - _gridBounds.lo[k]) * _invCellSize), _dims[k] - 1);
+	int c = (cell[2] * _dims[1] + cell[1]) * _dims[0] + cell[0];
+	for (int n = _cellOffsets[c]; n < _cellOffsets[c + 1]; ++n)
+	{
+		int i = _cellColliders[n];
+		if (_bounds[i].contains(p))
+			moved |= projectPoint(p, i);
+	}
+	return moved;
+}
+
+void ColliderSet::query(const AABB& box, std::vector<int>& result) const
+{
+	assert(_built);
+	result.assign(_unbounded.begin(), _unbounded.end());
+	if (_cellColliders.empty() || !box.overlaps(_gridBounds))
+		return;
+
+	int lo[3], hi[3];
+	cellRange(box, lo, hi);
+	size_t first = result.size();
+	for (int z = lo[2]; z <= hi[2]; ++z)
+		for (int y = lo[1]; y <= hi[1]; ++y)
+			for (int x = lo[0]; x <= hi[0]; ++x)
+			{
+				int c = (z * _dims[1] + y) * _dims[0] + x;
+				for (int n = _cellOffsets[c]; n < _cellOffsets[c + 1]; ++n)
+				{
+					int i = _cellColliders[n];
+					if (_bounds[i].overlaps(box))
+						result.push_back(i);
+				}
+			}
+	// a collider spanning several cells shows up once per cell
+	std::sort(result.begin() + first, result.end());
+	result.erase(std::unique(result.begin() + first, result.end()), result.end());
+}
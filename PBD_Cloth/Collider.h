@@ -0,0 +1,161 @@
+#ifndef COLLIDER_H
+#define COLLIDER_H
+
+#include <vector>
+#include <memory>
+#include "Vec.h"
+
+// axis aligned bounding box
+struct AABB
+{
+	Vec3f lo, hi;
+
+	AABB() : lo(1e30f), hi(-1e30f) {}  // empty
+	AABB(const Vec3f& lo, const Vec3f& hi) : lo(lo), hi(hi) {}
+
+	bool empty() const { return lo[0] > hi[0]; }
+	void expand(const Vec3f& p) { lo = min_union(lo, p); hi = max_union(hi, p); }
+	void expand(const AABB& b) { lo = min_union(lo, b.lo); hi = max_union(hi, b.hi); }
+	void inflate(float margin) { lo -= Vec3f(margin); hi += Vec3f(margin); }
+	bool contains(const Vec3f& p) const
+	{
+		return p[0] >= lo[0] && p[1] >= lo[1] && p[2] >= lo[2] && p[0] <= hi[0] && p[1] <= hi[1] && p[2] <= hi[2];
+	}
+	bool overlaps(const AABB& b) const
+	{
+		return lo[0] <= b.hi[0] && lo[1] <= b.hi[1] && lo[2] <= b.hi[2] && b.lo[0] <= hi[0] && b.lo[1] <= hi[1] && b.lo[2] <= hi[2];
+	}
+};
+
+// Linear contact constraint dot(x, normal) >= offset on one point, valid near where it was found.
+struct ContactPlane
+{
+	int point;
+	Vec3f normal;
+	float offset;
+	Vec3f velocity;  // of the surface the plane belongs to, for friction
+};
+
+// A solid the cloth points cannot enter. It may move between substeps (moved by whoever owns it); during a
+// substep its surface moves at velocity().
+class Collider
+{
+public:
+	virtual ~Collider() {}
+	virtual bool bounded() const { return true; }  // false: bounds() is meaningless, the collider is tested everywhere
+	virtual AABB bounds() const = 0;
+	// signed distance from p to the surface, negative inside; normal is the outward surface normal closest to p
+	virtual float signedDistance(const Vec3f& p, Vec3f& normal) const = 0;
+	// signedDistance() where only the points closer to the surface than maxDistance (or inside) matter: farther
+	// points may return any distance >= maxDistance and any normal. The default is the exact signedDistance()
+	virtual float boundedDistance(const Vec3f& p, float /*maxDistance*/, Vec3f& normal) const { return signedDistance(p, normal); }
+	// boundedDistance() together with velocity() of the same closest surface point, for contacts with friction.
+	// The default asks both separately; colliders that search for the closest point override it to search once
+	virtual float contactDistance(const Vec3f& p, float maxDistance, Vec3f& normal, Vec3f& surfaceVelocity) const
+	{
+		surfaceVelocity = velocity(p);
+		return boundedDistance(p, maxDistance, normal);
+	}
+	// first point where the segment from -> to enters the solid, at from + (to - from) * t with t in [0, 1];
+	// false if it stays outside or from is inside already. The default steps along the signed distance
+	// (conservative advancement), which needs signedDistance to never overestimate outside the solid
+	virtual bool raycast(const Vec3f& from, const Vec3f& to, float& t, Vec3f& normal) const;
+	// velocity of the surface point closest to p; 0 for solids that stand still
+	virtual Vec3f velocity(const Vec3f& /*p*/) const { return Vec3f(0.0f); }
+};
+
+class SphereCollider : public Collider
+{
+public:
+	Vec3f center;
+	float radius;
+
+	SphereCollider(const Vec3f& center, float radius) : center(center), radius(radius) {}
+	AABB bounds() const;
+	float signedDistance(const Vec3f& p, Vec3f& normal) const;
+	bool raycast(const Vec3f& from, const Vec3f& to, float& t, Vec3f& normal) const;
+};
+
+// all points within radius of the segment [a, b]
+class CapsuleCollider : public Collider
+{
+public:
+	Vec3f a, b;
+	float radius;
+
+	CapsuleCollider(const Vec3f& a, const Vec3f& b, float radius) : a(a), b(b), radius(radius) {}
+	AABB bounds() const;
+	float signedDistance(const Vec3f& p, Vec3f& normal) const;
+};
+
+// the half space below the plane through point with the given normal
+class PlaneCollider : public Collider
+{
+public:
+	Vec3f point;
+	Vec3f normal;  // unit length, pointing out of the solid
+
+	PlaneCollider(const Vec3f& point, const Vec3f& normal) : point(point), normal(normalized(normal)) {}
+	bool bounded() const { return false; }
+	AABB bounds() const { return AABB(Vec3f(-1e30f), Vec3f(1e30f)); }
+	float signedDistance(const Vec3f& p, Vec3f& normal) const;
+	bool raycast(const Vec3f& from, const Vec3f& to, float& t, Vec3f& normal) const;
+};
+
+// axis aligned box
+class BoxCollider : public Collider
+{
+public:
+	Vec3f center;
+	Vec3f halfExtents;
+
+	BoxCollider(const Vec3f& center, const Vec3f& halfExtents) : center(center), halfExtents(halfExtents) {}
+	AABB bounds() const { return AABB(center - halfExtents, center + halfExtents); }
+	float signedDistance(const Vec3f& p, Vec3f& normal) const;
+};
+
+// The colliders of a scene and a uniform grid broadphase over their bounds.
+// Each grid cell lists the bounded colliders overlapping it, so a point only tests the colliders of its cell;
+// unbounded colliders (planes) are tested everywhere. Call build() again after adding or moving colliders.
+class ColliderSet
+{
+public:
+	float cellSize = 0.0f;  // broadphase cell edge; <= 0 picks one from the average collider size
+
+	int add(std::shared_ptr<Collider> collider);  // returns the index of the collider
+	void clear();
+	int size() const { return (int)_colliders.size(); }
+	Collider& operator[](int i) { return *_colliders[i]; }
+	const Collider& operator[](int i) const { return *_colliders[i]; }
+	void build();  // rebuild the broadphase from the current collider bounds
+	bool built() const { return _built; }  // false after add() or clear() until build()
+
+	// move p out of every collider it is inside of; returns true if it was moved
+	bool projectPoint(Vec3f& p) const;
+	bool projectPoint(Vec3f& p, int collider) const;  // only out of the given collider, without the broadphase
+	// the tangent plane dot(x, normal) = offset of the collider's surface nearest to p, if p is closer to it than margin
+	// (or inside) and the collider gives a normal there; the plane is the linear contact constraint dot(x, normal) >= offset for points near p.
+	// velocity is the collider's surface velocity there
+	bool contactPlane(const Vec3f& p, int collider, float margin, Vec3f& normal, float& offset, Vec3f& velocity) const;
+	// stop the move from -> to where it enters the collider and keep only its tangential rest; returns true if it did.
+	// The collider is where it is at the end of the move, which took deltaTime: the move is swept relative to
+	// the collider's surface, starting where a point carried along by it from `from` would be now
+	bool sweepPoint(const Vec3f& from, Vec3f& to, int collider, float deltaTime = 0.0f) const;
+	// indices of the colliders whose bounds may overlap box, unbounded ones included
+	void query(const AABB& box, std::vector<int>& result) const;
+
+private:
+	std::vector<std::shared_ptr<Collider> > _colliders;
+	std::vector<AABB> _bounds;  // of each collider when build() was called
+	std::vector<int> _unbounded;
+	AABB _gridBounds;  // union of the bounded colliders
+	float _invCellSize = 0.0f;
+	int _dims[3] = { 0, 0, 0 };
+	std::vector<int> _cellOffsets;  // colliders of cell c are _cellColliders[offsets[c], offsets[c+1])
+	std::vector<int> _cellColliders;
+	bool _built = false;
+
+	void cellRange(const AABB& box, int lo[3], int hi[3]) const;  // clamped cells overlapping box
+};
+
+#endif
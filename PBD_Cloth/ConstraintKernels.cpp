@@ -0,0 +1,248 @@
+#include "ConstraintKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// the vectorized kernels are compiled for their instruction set only, the rest of the build stays generic
+#if defined(KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+static float projectDistanceScalar(Vec3f* predPos, const float* invMass, const Vec2i* constraints, const float* restLength,
+	int begin, int end, float stiffness)
+{
+	float maxStretch = 0.0f;
+	for (int i = begin; i < end; ++i)
+	{
+		int i1 = constraints[i][0];
+		int i2 = constraints[i][1];
+		float w1 = invMass[i1];
+		float w2 = invMass[i2];
+		float sumInvMass = w1 + w2;
+		if (sumInvMass <= M_EPSION)
+			continue;
+
+		Vec3f vecP2P1 = predPos[i1] - predPos[i2];
+		float magP2P1 = mag(vecP2P1);
+		if (magP2P1 <= M_EPSION)
+			continue;
+
+		float stretch = magP2P1 - restLength[i];
+		maxStretch = max(maxStretch, std::fabs(stretch) / restLength[i]);
+
+		// direction * scaler
+		Vec3f distProj = vecP2P1 * (stretch / (magP2P1 * sumInvMass) * stiffness);
+		predPos[i1] -= distProj * w1;
+		predPos[i2] += distProj * w2;
+	}
+	return maxStretch;
+}
+
+#ifdef KERNELS_X86
+
+TARGET_AVX2
+static float projectDistanceAVX2(Vec3f* predPos, const float* invMass, const Vec2i* constraints, const float* restLength,
+	int begin, int end, float stiffness)
+{
+	float* pf = &predPos[0][0];
+	const __m256i stride2 = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+	const __m256i three = _mm256_set1_epi32(3);
+	const __m256 eps = _mm256_set1_ps(M_EPSION);
+	const __m256 k = _mm256_set1_ps(stiffness);
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 maxStretch = _mm256_setzero_ps();
+	alignas(32) int idx1[8], idx2[8];
+	alignas(32) float out1[3][8], out2[3][8];
+
+	int i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		// point indices of 8 constraints, deinterleaved from the Vec2i pairs
+		const int* pairs = &constraints[i][0];
+		__m256i a = _mm256_i32gather_epi32(pairs, stride2, 4);
+		__m256i b = _mm256_i32gather_epi32(pairs + 1, stride2, 4);
+		__m256i a3 = _mm256_mullo_epi32(a, three);
+		__m256i b3 = _mm256_mullo_epi32(b, three);
+
+		__m256 x1 = _mm256_i32gather_ps(pf, a3, 4);
+		__m256 y1 = _mm256_i32gather_ps(pf + 1, a3, 4);
+		__m256 z1 = _mm256_i32gather_ps(pf + 2, a3, 4);
+		__m256 x2 = _mm256_i32gather_ps(pf, b3, 4);
+		__m256 y2 = _mm256_i32gather_ps(pf + 1, b3, 4);
+		__m256 z2 = _mm256_i32gather_ps(pf + 2, b3, 4);
+		__m256 w1 = _mm256_i32gather_ps(invMass, a, 4);
+		__m256 w2 = _mm256_i32gather_ps(invMass, b, 4);
+		__m256 rest = _mm256_loadu_ps(restLength + i);
+
+		__m256 dx = _mm256_sub_ps(x1, x2);
+		__m256 dy = _mm256_sub_ps(y1, y2);
+		__m256 dz = _mm256_sub_ps(z1, z2);
+		__m256 len = _mm256_sqrt_ps(_mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz))));
+		__m256 sumInvMass = _mm256_add_ps(w1, w2);
+
+		// degenerate constraints (two fixed points, zero length) are skipped like in the scalar kernel
+		__m256 valid = _mm256_and_ps(_mm256_cmp_ps(sumInvMass, eps, _CMP_GT_OQ), _mm256_cmp_ps(len, eps, _CMP_GT_OQ));
+		__m256 denom = _mm256_blendv_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(len, sumInvMass), valid);
+		__m256 stretch = _mm256_sub_ps(len, rest);
+		__m256 s = _mm256_and_ps(_mm256_mul_ps(_mm256_div_ps(stretch, denom), k), valid);
+		maxStretch = _mm256_max_ps(maxStretch, _mm256_and_ps(_mm256_div_ps(_mm256_and_ps(stretch, absMask), rest), valid));
+
+		__m256 cx = _mm256_mul_ps(dx, s);
+		__m256 cy = _mm256_mul_ps(dy, s);
+		__m256 cz = _mm256_mul_ps(dz, s);
+		_mm256_store_ps(out1[0], _mm256_fnmadd_ps(cx, w1, x1));
+		_mm256_store_ps(out1[1], _mm256_fnmadd_ps(cy, w1, y1));
+		_mm256_store_ps(out1[2], _mm256_fnmadd_ps(cz, w1, z1));
+		_mm256_store_ps(out2[0], _mm256_fmadd_ps(cx, w2, x2));
+		_mm256_store_ps(out2[1], _mm256_fmadd_ps(cy, w2, y2));
+		_mm256_store_ps(out2[2], _mm256_fmadd_ps(cz, w2, z2));
+		_mm256_store_si256((__m256i*)idx1, a);
+		_mm256_store_si256((__m256i*)idx2, b);
+
+		// AVX2 has no scatter; the lanes touch distinct points so the order does not matter
+		for (int l = 0; l < 8; ++l)
+		{
+			predPos[idx1[l]] = Vec3f(out1[0][l], out1[1][l], out1[2][l]);
+			predPos[idx2[l]] = Vec3f(out2[0][l], out2[1][l], out2[2][l]);
+		}
+	}
+	alignas(32) float lanes[8];
+	_mm256_store_ps(lanes, maxStretch);
+	float result = projectDistanceScalar(predPos, invMass, constraints, restLength, i, end, stiffness);
+	for (int l = 0; l < 8; ++l)
+		result = max(result, lanes[l]);
+	return result;
+}
+
+TARGET_AVX512
+static float projectDistanceAVX512(Vec3f* predPos, const float* invMass, const Vec2i* constraints, const float* restLength,
+	int begin, int end, float stiffness)
+{
+	float* pf = &predPos[0][0];
+	const __m512i stride2 = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+	const __m512i three = _mm512_set1_epi32(3);
+	const __m512 eps = _mm512_set1_ps(M_EPSION);
+	const __m512 k = _mm512_set1_ps(stiffness);
+	__m512 maxStretch = _mm512_setzero_ps();
+
+	int i = begin;
+	for (; i + 16 <= end; i += 16)
+	{
+		// point indices of 16 constraints, deinterleaved from the Vec2i pairs
+		const int* pairs = &constraints[i][0];
+		__m512i a = _mm512_i32gather_epi32(stride2, pairs, 4);
+		__m512i b = _mm512_i32gather_epi32(stride2, pairs + 1, 4);
+		__m512i a3 = _mm512_mullo_epi32(a, three);
+		__m512i b3 = _mm512_mullo_epi32(b, three);
+
+		__m512 x1 = _mm512_i32gather_ps(a3, pf, 4);
+		__m512 y1 = _mm512_i32gather_ps(a3, pf + 1, 4);
+		__m512 z1 = _mm512_i32gather_ps(a3, pf + 2, 4);
+		__m512 x2 = _mm512_i32gather_ps(b3, pf, 4);
+		__m512 y2 = _mm512_i32gather_ps(b3, pf + 1, 4);
+		__m512 z2 = _mm512_i32gather_ps(b3, pf + 2, 4);
+		__m512 w1 = _mm512_i32gather_ps(a, invMass, 4);
+		__m512 w2 = _mm512_i32gather_ps(b, invMass, 4);
+		__m512 rest = _mm512_loadu_ps(restLength + i);
+
+		__m512 dx = _mm512_sub_ps(x1, x2);
+		__m512 dy = _mm512_sub_ps(y1, y2);
+		__m512 dz = _mm512_sub_ps(z1, z2);
+		__m512 len = _mm512_sqrt_ps(_mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz))));
+		__m512 sumInvMass = _mm512_add_ps(w1, w2);
+
+		// degenerate constraints (two fixed points, zero length) are skipped like in the scalar kernel
+		__mmask16 valid = _mm512_cmp_ps_mask(sumInvMass, eps, _CMP_GT_OQ) & _mm512_cmp_ps_mask(len, eps, _CMP_GT_OQ);
+		__m512 stretch = _mm512_sub_ps(len, rest);
+		__m512 s = _mm512_maskz_div_ps(valid, _mm512_mul_ps(stretch, k), _mm512_mul_ps(len, sumInvMass));
+		maxStretch = _mm512_mask_max_ps(maxStretch, valid, maxStretch, _mm512_div_ps(_mm512_abs_ps(stretch), rest));
+
+		__m512 cx = _mm512_mul_ps(dx, s);
+		__m512 cy = _mm512_mul_ps(dy, s);
+		__m512 cz = _mm512_mul_ps(dz, s);
+		_mm512_mask_i32scatter_ps(pf, valid, a3, _mm512_fnmadd_ps(cx, w1, x1), 4);
+		_mm512_mask_i32scatter_ps(pf + 1, valid, a3, _mm512_fnmadd_ps(cy, w1, y1), 4);
+		_mm512_mask_i32scatter_ps(pf + 2, valid, a3, _mm512_fnmadd_ps(cz, w1, z1), 4);
+		_mm512_mask_i32scatter_ps(pf, valid, b3, _mm512_fmadd_ps(cx, w2, x2), 4);
+		_mm512_mask_i32scatter_ps(pf + 1, valid, b3, _mm512_fmadd_ps(cy, w2, y2), 4);
+		_mm512_mask_i32scatter_ps(pf + 2, valid, b3, _mm512_fmadd_ps(cz, w2, z2), 4);
+	}
+	float result = projectDistanceScalar(predPos, invMass, constraints, restLength, i, end, stiffness);
+	return max(result, _mm512_reduce_max_ps(maxStretch));
+}
+
+static bool cpuHasAVX2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool fma = (info[2] & (1 << 12)) != 0;
+	if (!osxsave || !fma || (_xgetbv(0) & 0x6) != 0x6)  // the os must save the ymm registers
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+static bool cpuHasAVX512()
+{
+#if defined(_MSC_VER)
+	if (!cpuHasAVX2() || (_xgetbv(0) & 0xe6) != 0xe6)  // the os must save the zmm and opmask registers
+		return false;
+	int info[4];
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 16)) != 0;
+#else
+	return __builtin_cpu_supports("avx512f");
+#endif
+}
+
+#endif // KERNELS_X86
+
+KernelISA detectKernelISA()
+{
+#ifdef KERNELS_X86
+	if (cpuHasAVX512())
+		return KERNEL_AVX512;
+	if (cpuHasAVX2())
+		return KERNEL_AVX2;
+#endif
+	return KERNEL_SCALAR;
+}
+
+DistanceKernel distanceKernel(KernelISA isa)
+{
+#ifdef KERNELS_X86
+	KernelISA supported = detectKernelISA();
+	if (isa == KERNEL_AVX512 && supported == KERNEL_AVX512)
+		return projectDistanceAVX512;
+	if (isa != KERNEL_SCALAR && supported != KERNEL_SCALAR)
+		return projectDistanceAVX2;
+#endif
+	return projectDistanceScalar;
+}
+
+const char* kernelISAName(KernelISA isa)
+{
+	switch (isa)
+	{
+	case KERNEL_AVX2: return "avx2";
+	case KERNEL_AVX512: return "avx512";
+	default: return "scalar";
+	}
+}
@@ -0,0 +1,28 @@
+#ifndef CONSTRAINTKERNELS_H
+#define CONSTRAINTKERNELS_H
+
+#include "Vec.h"
+
+// Batched projection of distance constraints.
+// A kernel projects constraints [begin, end) of ONE color batch: no two of these constraints
+// may share a point, so the vectorized kernels can load and store 8 (AVX2) or 16 (AVX-512)
+// constraints at once without conflicts. The result matches a serial Gauss-Seidel sweep over
+// the same batch up to floating point rounding.
+// Kernels return the largest relative stretch |length - rest| / rest they saw before correcting,
+// which the solver uses as a cheap residual.
+
+enum KernelISA
+{
+	KERNEL_SCALAR,
+	KERNEL_AVX2,
+	KERNEL_AVX512
+};
+
+typedef float(*DistanceKernel)(Vec3f* predPos, const float* invMass, const Vec2i* constraints, const float* restLength,
+	int begin, int end, float stiffness);
+
+KernelISA detectKernelISA();  // best instruction set supported by this cpu and build
+DistanceKernel distanceKernel(KernelISA isa);  // falls back to a narrower kernel if isa is not supported
+const char* kernelISAName(KernelISA isa);
+
+#endif
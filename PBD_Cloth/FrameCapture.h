@@ -0,0 +1,195 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ImageWriter.h"
+#include "ThreadPool.h"
+
+// Saves rendered frames as image files without stalling the render thread. capture() only starts an
+// asynchronous glReadPixels into the next pixel buffer object of a ring, behind a fence. The PBO is mapped
+// when the ring comes back around to it, numBuffers - 1 frames later, by when the GPU has long finished the
+// copy. Its pixels go into a CPU buffer, and a writer thread encodes and writes the file; several frames are
+// encoded at once by the writers. The CPU buffers are recycled, so once as many are around as the writers
+// keep busy, nothing is allocated per frame any more. There are at most maxFrames of them: when the writers
+// fall behind, capture() waits for one to finish a frame rather than piling up frames in memory.
+// All calls have to come from the thread that owns the GL context.
+class FrameCapture
+{
+public:
+	explicit FrameCapture(ImageFormat format = IMAGE_TGA, int numBuffers = 3, int numWriters = 2, int maxFrames = 8)
+		: _format(format), _slots(std::max(numBuffers, 2)), _writers(numWriters + 1),  // the pool counts the calling thread, which never writes
+		_maxFrames(std::max(maxFrames, 1))
+	{
+		for (size_t s = 0; s < _slots.size(); ++s)
+			glGenBuffers(1, &_slots[s].pbo);
+	}
+
+	~FrameCapture()
+	{
+		finish();
+		for (size_t s = 0; s < _slots.size(); ++s)
+			glDeleteBuffers(1, &_slots[s].pbo);
+	}
+
+	// queue the viewport of the back buffer, so call it before swapping
+	void capture(const std::string& fileName)
+	{
+		Slot& slot = _slots[_next];
+		_next = (_next + 1) % (int)_slots.size();
+		retire(slot);
+
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		slot.width = viewport[2];
+		slot.height = viewport[3];
+		slot.fileName = fileName;
+		int size = imageSize(slot.width, slot.height);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		if (slot.size != size)
+		{
+			glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+			slot.size = size;
+		}
+		// targas are tightly packed
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_PACK_SKIP_ROWS, 0);
+		glPixelStorei(GL_PACK_SKIP_PIXELS, 0);
+		GLint lastBuffer;
+		glGetIntegerv(GL_READ_BUFFER, &lastBuffer);
+		glReadBuffer(GL_BACK);
+		glReadPixels(viewport[0], viewport[1], slot.width, slot.height, GL_BGR, GL_UNSIGNED_BYTE, (void*)0);
+		glReadBuffer(lastBuffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	// hand all queued frames to the writers and wait until they are on disk
+	void finish()
+	{
+		// oldest first, so the files are started in the order of the frames
+		for (size_t s = 0; s < _slots.size(); ++s)
+			retire(_slots[(_next + s) % _slots.size()]);
+		_writers.wait();
+	}
+
+	int written() const { return _written; }
+	int failed() const { return _failed; }
+
+private:
+	// pixels read back and the file they are encoded into, reused from frame to frame
+	struct Frame
+	{
+		std::vector<unsigned char> pixels;
+		std::vector<unsigned char> encoded;
+	};
+
+	struct Slot
+	{
+		GLuint pbo = 0;
+		GLsync fence = 0;  // 0: holds no frame
+		int size = 0;  // of the buffer storage
+		int width = 0, height = 0;
+		std::string fileName;
+	};
+
+	ImageFormat _format;
+	std::vector<Slot> _slots;
+	int _next = 0;  // slot of the next capture, which is also the oldest queued frame
+	ThreadPool _writers;
+	std::mutex _mutex;  // guards _free and _numFrames
+	std::condition_variable _recycled;
+	std::vector<std::unique_ptr<Frame> > _free;  // CPU buffers the writers are done with
+	int _numFrames = 0;  // CPU buffers allocated, free or queued for writing
+	int _maxFrames;
+	std::atomic<int> _written{ 0 };
+	std::atomic<int> _failed{ 0 };
+
+	FrameCapture(const FrameCapture&);
+	FrameCapture& operator=(const FrameCapture&);
+
+	static int imageSize(int width, int height) { return width * height * 3; }
+
+	// copy the frame of the slot out of its PBO and queue it for writing
+	void retire(Slot& slot)
+	{
+		if (!slot.fence)
+			return;
+		glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);  // done frames ago as a rule
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+
+		std::unique_ptr<Frame> frame;
+		{
+			// all buffers in use: wait for a writer to give one back
+			std::unique_lock<std::mutex> lock(_mutex);
+			_recycled.wait(lock, [&]() { return !_free.empty() || _numFrames < _maxFrames; });
+			if (!_free.empty())
+			{
+				frame = std::move(_free.back());
+				_free.pop_back();
+			}
+			else
+				_numFrames++;
+		}
+		if (!frame)
+			frame.reset(new Frame());
+		std::vector<unsigned char>& pixels = frame->pixels;
+		pixels.resize(imageSize(slot.width, slot.height));  // keeps the capacity, so no allocation after the first frames
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pixels.size(), GL_MAP_READ_BIT);
+		bool ok = mapped != NULL;
+		if (ok)
+		{
+			memcpy(pixels.data(), mapped, pixels.size());
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		if (!ok)
+		{
+			printf("saving %s failed!\n", slot.fileName.c_str());
+			_failed++;
+			recycle(std::move(frame));
+			return;
+		}
+
+		// the task owns the buffers through a raw pointer, std::function needs a copyable task
+		Frame* owned = frame.release();
+		std::string fileName = slot.fileName;
+		int width = slot.width, height = slot.height;
+		_writers.enqueue([this, owned, fileName, width, height]()
+		{
+			std::unique_ptr<Frame> frame(owned);
+			if (writeImage(fileName, frame->pixels.data(), width, height, _format, frame->encoded))
+				_written++;
+			else
+			{
+				printf("saving %s failed!\n", fileName.c_str());
+				_failed++;
+			}
+			recycle(std::move(frame));
+		});
+	}
+
+	void recycle(std::unique_ptr<Frame> frame)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_free.push_back(std::move(frame));
+		}
+		_recycled.notify_one();
+	}
+};
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include "Vec.h"
+
+// Closest point to p on the triangle abc (Ericson, Real-Time Collision Detection, 5.1.5), and its barycentric
+// coordinates uvw; those are exactly 0 for the vertices the point is not blended from, so they also tell
+// whether it lies on a vertex, an edge or inside the face.
+inline Vec3f closestPointOnTriangle(const Vec3f& p, const Vec3f& a, const Vec3f& b, const Vec3f& c, Vec3f& uvw)
+{
+	Vec3f ab = b - a;
+	Vec3f ac = c - a;
+	Vec3f ap = p - a;
+	float d1 = dot(ab, ap);
+	float d2 = dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)
+	{
+		uvw = Vec3f(1.0f, 0.0f, 0.0f);
+		return a;  // vertex region a
+	}
+
+	Vec3f bp = p - b;
+	float d3 = dot(ab, bp);
+	float d4 = dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3)
+	{
+		uvw = Vec3f(0.0f, 1.0f, 0.0f);
+		return b;  // vertex region b
+	}
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+	{
+		float v = d1 / (d1 - d3);
+		uvw = Vec3f(1.0f - v, v, 0.0f);
+		return a + ab * v;  // edge ab
+	}
+
+	Vec3f cp = p - c;
+	float d5 = dot(ab, cp);
+	float d6 = dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6)
+	{
+		uvw = Vec3f(0.0f, 0.0f, 1.0f);
+		return c;  // vertex region c
+	}
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+	{
+		float w = d2 / (d2 - d6);
+		uvw = Vec3f(1.0f - w, 0.0f, w);
+		return a + ac * w;  // edge ac
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+	{
+		float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		uvw = Vec3f(0.0f, 1.0f - w, w);
+		return b + (c - b) * w;  // edge bc
+	}
+
+	// inside the face
+	float denom = 1 / (va + vb + vc);
+	uvw = Vec3f(1.0f - (vb + vc) * denom, vb * denom, vc * denom);
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+inline Vec3f closestPointOnTriangle(const Vec3f& p, const Vec3f& a, const Vec3f& b, const Vec3f& c)
+{
+	Vec3f uvw;
+	return closestPointOnTriangle(p, a, b, c, uvw);
+}
+
+// Where the line through (y, z) parallel to the x axis crosses the triangle abc.
+// Returns false if it misses the triangle or runs in its plane.
+inline bool crossTriangleX(float y, float z, const Vec3f& a, const Vec3f& b, const Vec3f& c, float& x)
+{
+	// signed areas of the sub triangles in the yz projection
+	float wc = (b[1] - a[1]) * (z - a[2]) - (b[2] - a[2]) * (y - a[1]);
+	float wa = (c[1] - b[1]) * (z - b[2]) - (c[2] - b[2]) * (y - b[1]);
+	float wb = (a[1] - c[1]) * (z - c[2]) - (a[2] - c[2]) * (y - c[1]);
+	if (!((wa > 0.0f && wb > 0.0f && wc > 0.0f) || (wa < 0.0f && wb < 0.0f && wc < 0.0f)))
+		return false;
+	x = (wa * a[0] + wb * b[0] + wc * c[0]) / (wa + wb + wc);
+	return true;
+}
+
+// Barycentric coordinates (u, v, w) of p with respect to the triangle abc, p = u * a + v * b + w * c
+// for p in the plane of the triangle (Ericson, 3.4). Returns false for a degenerate triangle.
+inline bool barycentric(const Vec3f& p, const Vec3f& a, const Vec3f& b, const Vec3f& c, Vec3f& uvw)
+{
+	Vec3f v0 = b - a, v1 = c - a, v2 = p - a;
+	float d00 = dot(v0, v0);
+	float d01 = dot(v0, v1);
+	float d11 = dot(v1, v1);
+	float d20 = dot(v2, v0);
+	float d21 = dot(v2, v1);
+	float denom = d00 * d11 - d01 * d01;
+	if (denom <= M_EPSION * d00 * d11)
+		return false;
+	uvw[1] = (d11 * d20 - d01 * d21) / denom;
+	uvw[2] = (d00 * d21 - d01 * d20) / denom;
+	uvw[0] = 1.0f - uvw[1] - uvw[2];
+	return true;
+}
+
+// Closest points p0 + (p1 - p0) * s and q0 + (q1 - q0) * t of two segments (Ericson, 5.1.9).
+inline void closestPointsOnSegments(const Vec3f& p0, const Vec3f& p1, const Vec3f& q0, const Vec3f& q1, float& s, float& t)
+{
+	Vec3f d1 = p1 - p0, d2 = q1 - q0, r = p0 - q0;
+	float a = dot(d1, d1);
+	float e = dot(d2, d2);
+	float f = dot(d2, r);
+	s = t = 0.0f;
+	if (a <= M_EPSION && e <= M_EPSION)
+		return;  // both are points
+	if (a <= M_EPSION)
+	{
+		t = clamp(f / e, 0.0f, 1.0f);
+		return;
+	}
+	float c = dot(d1, r);
+	if (e <= M_EPSION)
+	{
+		s = clamp(-c / a, 0.0f, 1.0f);
+		return;
+	}
+	float b = dot(d1, d2);
+	float denom = a * e - b * b;
+	s = denom > M_EPSION * a * e ? clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;  // parallel: any s
+	t = (b * s + f) / e;
+	if (t < 0.0f)
+	{
+		t = 0.0f;
+		s = clamp(-c / a, 0.0f, 1.0f);
+	}
+	else if (t > 1.0f)
+	{
+		t = 1.0f;
+		s = clamp((b - c) / a, 0.0f, 1.0f);
+	}
+}
+
+#endif
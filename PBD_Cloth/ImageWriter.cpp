@@ -0,0 +1,326 @@
+#include "ImageWriter.h"
+
+#include <cstdio>
+#include <cstring>
+
+// rows per independently encoded strip, and strips handed to one task of the thread pool
+static const int STRIP_ROWS = 32;
+static const int STRIP_GRAIN = 1;
+// neither encoding takes more than 4 bytes per pixel: a targa packet header per pixel at worst, a QOI_OP_RGB
+static const int MAX_BYTES_PER_PIXEL = 4;
+
+static const int TGA_HEADER_SIZE = 18;
+static const int QOI_HEADER_SIZE = 14;
+static const unsigned char QOI_END[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+static const unsigned char QOI_OP_INDEX = 0x00, QOI_OP_DIFF = 0x40, QOI_OP_LUMA = 0x80, QOI_OP_RUN = 0xc0, QOI_OP_RGB = 0xfe;
+static const int QOI_MAX_RUN = 62;
+static const int TGA_MAX_PACKET = 128;
+
+// a pixel as r, g, b, a from the low to the high byte
+typedef unsigned int Pixel;
+
+static inline Pixel readPixel(const unsigned char* bgr)
+{
+	return bgr[2] | (bgr[1] << 8) | (bgr[0] << 16) | 0xff000000u;
+}
+
+static inline int qoiHash(Pixel p)
+{
+	return ((p & 0xff) * 3 + ((p >> 8) & 0xff) * 5 + ((p >> 16) & 0xff) * 7 + (p >> 24) * 11) % 64;
+}
+
+template<class F>
+static void runParallel(ThreadPool* pool, int begin, int end, int grainSize, const F& func)
+{
+	if (pool)
+		pool->parallelFor(begin, end, grainSize, func);
+	else
+		func(begin, end);
+}
+
+const char* imageFormatName(ImageFormat format)
+{
+	switch (format)
+	{
+	case IMAGE_TGA_RLE: return "rle";
+	case IMAGE_QOI: return "qoi";
+	default: return "tga";
+	}
+}
+
+bool parseImageFormat(const std::string& name, ImageFormat& format)
+{
+	if (name == "tga")
+		format = IMAGE_TGA;
+	else if (name == "rle")
+		format = IMAGE_TGA_RLE;
+	else if (name == "qoi")
+		format = IMAGE_QOI;
+	else
+		return false;
+	return true;
+}
+
+const char* imageExtension(ImageFormat format)
+{
+	return format == IMAGE_QOI ? ".qoi" : ".tga";
+}
+
+std::string frameFileName(const std::string& dir, int frame, int digits, ImageFormat format)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%0*d_frame%s", digits, frame, imageExtension(format));
+	if (dir.empty())
+		return name;
+	char last = dir[dir.size() - 1];
+	return last == '/' || last == '\\' ? dir + name : dir + "/" + name;
+}
+
+static void writeTGAHeader(unsigned char* header, int width, int height, bool rle)
+{
+	memset(header, 0, TGA_HEADER_SIZE);
+	header[2] = rle ? 10 : 2;  // true color, run length encoded or not
+	header[12] = (unsigned char)(width & 0xff);  // little endian, whatever the host is
+	header[13] = (unsigned char)(width >> 8);
+	header[14] = (unsigned char)(height & 0xff);
+	header[15] = (unsigned char)(height >> 8);
+	header[16] = 24;  // bits per pixel; the descriptor stays 0: origin at the bottom left, like the input
+}
+
+static void writeBigEndian(unsigned char* out, unsigned int value)
+{
+	out[0] = (unsigned char)(value >> 24);
+	out[1] = (unsigned char)(value >> 16);
+	out[2] = (unsigned char)(value >> 8);
+	out[3] = (unsigned char)value;
+}
+
+// Packets never cross rows, as the targa spec asks. A repeated pixel becomes a run packet, anything else
+// goes into a raw packet that ends where the next run starts
+static unsigned char* encodeTGARow(const unsigned char* row, int width, unsigned char* out)
+{
+	int x = 0;
+	while (x < width)
+	{
+		const unsigned char* p = row + 3 * x;
+		int run = 1;
+		while (x + run < width && run < TGA_MAX_PACKET && memcmp(p, p + 3 * run, 3) == 0)
+			run++;
+		if (run > 1)
+		{
+			*out++ = (unsigned char)(0x80 | (run - 1));
+			memcpy(out, p, 3);
+			out += 3;
+			x += run;
+			continue;
+		}
+		int count = 1;
+		while (x + count < width && count < TGA_MAX_PACKET &&
+			!(x + count + 1 < width && memcmp(p + 3 * count, p + 3 * (count + 1), 3) == 0))
+			count++;
+		*out++ = (unsigned char)(count - 1);
+		memcpy(out, p, 3 * count);
+		out += 3 * count;
+		x += count;
+	}
+	return out;
+}
+
+// QOI state a decoder has before a pixel: the previous pixel and the last pixel seen with each hash
+struct QOIState
+{
+	Pixel previous;
+	Pixel index[64];
+};
+
+// QOI rows go top to bottom, the input bottom to top; output row r is input row height - 1 - r
+static unsigned char* encodeQOIRows(const unsigned char* bgr, int width, int height, int rowBegin, int rowEnd,
+	QOIState& state, unsigned char* out)
+{
+	Pixel previous = state.previous;
+	Pixel* index = state.index;
+	int run = 0;
+	for (int r = rowBegin; r < rowEnd; ++r)
+	{
+		const unsigned char* row = bgr + (size_t)(height - 1 - r) * width * 3;
+		for (int x = 0; x < width; ++x)
+		{
+			Pixel p = readPixel(row + 3 * x);
+			if (p == previous)
+			{
+				if (++run == QOI_MAX_RUN)
+				{
+					*out++ = (unsigned char)(QOI_OP_RUN | (run - 1));
+					run = 0;
+				}
+				continue;
+			}
+			if (run > 0)
+			{
+				*out++ = (unsigned char)(QOI_OP_RUN | (run - 1));
+				run = 0;
+			}
+			int hash = qoiHash(p);
+			if (index[hash] == p)
+				*out++ = (unsigned char)(QOI_OP_INDEX | hash);
+			else
+			{
+				index[hash] = p;
+				// alpha is always 255, so only the color channels differ
+				signed char dr = (signed char)((p & 0xff) - (previous & 0xff));
+				signed char dg = (signed char)(((p >> 8) & 0xff) - ((previous >> 8) & 0xff));
+				signed char db = (signed char)(((p >> 16) & 0xff) - ((previous >> 16) & 0xff));
+				int drg = dr - dg, dbg = db - dg;
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+					*out++ = (unsigned char)(QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+				else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+				{
+					*out++ = (unsigned char)(QOI_OP_LUMA | (dg + 32));
+					*out++ = (unsigned char)(((drg + 8) << 4) | (dbg + 8));
+				}
+				else
+				{
+					*out++ = QOI_OP_RGB;
+					*out++ = (unsigned char)(p & 0xff);
+					*out++ = (unsigned char)((p >> 8) & 0xff);
+					*out++ = (unsigned char)((p >> 16) & 0xff);
+				}
+			}
+			previous = p;
+		}
+	}
+	if (run > 0)
+		*out++ = (unsigned char)(QOI_OP_RUN | (run - 1));  // runs end with the strip; the next one starts afresh
+	return out;
+}
+
+void encodeImage(const unsigned char* bgr, int width, int height, ImageFormat format, std::vector<unsigned char>& out,
+	ThreadPool* pool)
+{
+	size_t rowSize = (size_t)width * 3;
+	if (format == IMAGE_TGA)
+	{
+		out.resize(TGA_HEADER_SIZE + rowSize * height);
+		writeTGAHeader(out.data(), width, height, false);
+		memcpy(out.data() + TGA_HEADER_SIZE, bgr, rowSize * height);
+		return;
+	}
+
+	// every strip is encoded into its own worst case sized slot of out, then the slots are moved together
+	int numStrips = (height + STRIP_ROWS - 1) / STRIP_ROWS;
+	size_t headerSize = format == IMAGE_QOI ? QOI_HEADER_SIZE : TGA_HEADER_SIZE;
+	size_t slotSize = (size_t)width * STRIP_ROWS * MAX_BYTES_PER_PIXEL;
+	out.resize(headerSize + slotSize * numStrips + sizeof(QOI_END));
+	std::vector<size_t> stripSizes(numStrips);
+	unsigned char* slots = out.data() + headerSize;
+
+	if (format == IMAGE_TGA_RLE)
+	{
+		writeTGAHeader(out.data(), width, height, true);
+		runParallel(pool, 0, numStrips, STRIP_GRAIN, [&](int begin, int end)
+		{
+			for (int s = begin; s < end; ++s)
+			{
+				unsigned char* stripOut = slots + slotSize * s;
+				unsigned char* p = stripOut;
+				for (int y = s * STRIP_ROWS; y < min((s + 1) * STRIP_ROWS, height); ++y)
+					p = encodeTGARow(bgr + rowSize * y, width, p);
+				stripSizes[s] = p - stripOut;
+			}
+		});
+	}
+	else
+	{
+		memcpy(out.data(), "qoif", 4);
+		writeBigEndian(out.data() + 4, width);
+		writeBigEndian(out.data() + 8, height);
+		out[12] = 3;  // channels: rgb
+		out[13] = 0;  // sRGB with linear alpha
+
+		// a strip can only refer to index entries the decoder will have: first the last pixel of each hash
+		// within each strip, then their running union is the state at the start of every strip
+		std::vector<QOIState> states(numStrips);
+		std::vector<unsigned long long> seen(numStrips);
+		runParallel(pool, 0, numStrips, STRIP_GRAIN, [&](int begin, int end)
+		{
+			for (int s = begin; s < end; ++s)
+			{
+				QOIState& state = states[s];
+				unsigned long long mask = 0;
+				for (int r = s * STRIP_ROWS; r < min((s + 1) * STRIP_ROWS, height); ++r)
+				{
+					const unsigned char* row = bgr + rowSize * (height - 1 - r);
+					for (int x = 0; x < width; ++x)
+					{
+						Pixel p = readPixel(row + 3 * x);
+						int hash = qoiHash(p);
+						state.index[hash] = p;
+						mask |= 1ull << hash;
+						state.previous = p;
+					}
+				}
+				seen[s] = mask;
+			}
+		});
+		QOIState running;
+		running.previous = 0xff000000u;  // opaque black before the first pixel, and an index of zeros
+		memset(running.index, 0, sizeof(running.index));
+		for (int s = 0; s < numStrips; ++s)
+		{
+			QOIState strip = states[s];
+			states[s] = running;
+			for (int hash = 0; hash < 64; ++hash)
+				if (seen[s] >> hash & 1)
+					running.index[hash] = strip.index[hash];
+			if (seen[s])
+				running.previous = strip.previous;
+		}
+
+		runParallel(pool, 0, numStrips, STRIP_GRAIN, [&](int begin, int end)
+		{
+			for (int s = begin; s < end; ++s)
+			{
+				unsigned char* stripOut = slots + slotSize * s;
+				unsigned char* p = encodeQOIRows(bgr, width, height, s * STRIP_ROWS, min((s + 1) * STRIP_ROWS, height),
+					states[s], stripOut);
+				stripSizes[s] = p - stripOut;
+			}
+		});
+	}
+
+	// strip 0 is in place already; memmove since later slots can overlap the space earlier ones left
+	size_t size = headerSize + stripSizes[0];
+	for (int s = 1; s < numStrips; ++s)
+	{
+		memmove(out.data() + size, slots + slotSize * s, stripSizes[s]);
+		size += stripSizes[s];
+	}
+	if (format == IMAGE_QOI)
+	{
+		memcpy(out.data() + size, QOI_END, sizeof(QOI_END));
+		size += sizeof(QOI_END);
+	}
+	out.resize(size);
+}
+
+bool writeImage(const std::string& fileName, const unsigned char* bgr, int width, int height, ImageFormat format,
+	std::vector<unsigned char>& buffer, ThreadPool* pool)
+{
+	FILE* pFile = fopen(fileName.c_str(), "wb");
+	if (pFile == NULL)
+		return false;
+	bool ok;
+	if (format == IMAGE_TGA)
+	{
+		// nothing to encode, the pixels are written as they are
+		unsigned char header[TGA_HEADER_SIZE];
+		writeTGAHeader(header, width, height, false);
+		ok = fwrite(header, sizeof(header), 1, pFile) == 1 && fwrite(bgr, (size_t)width * height * 3, 1, pFile) == 1;
+	}
+	else
+	{
+		encodeImage(bgr, width, height, format, buffer, pool);
+		ok = fwrite(buffer.data(), buffer.size(), 1, pFile) == 1;
+	}
+	return fclose(pFile) == 0 && ok;
+}
@@ -0,0 +1,37 @@
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include <string>
+#include <vector>
+#include "ThreadPool.h"
+
+// Image files of rendered frames. Images are 24 bit, in the layout glReadPixels(GL_BGR, GL_UNSIGNED_BYTE)
+// delivers with a pack alignment of 1: tightly packed rows, bottom row first, blue green red.
+// Besides plain targa files there are two compressed formats that need no libraries:
+// run length encoded targa (read by everything that reads targa) and QOI ("quite OK image format",
+// https://qoiformat.org), which typically takes less space and encodes as fast.
+// The compressed formats are encoded in strips of rows, independently of each other, so a pool can encode
+// the strips of one image in parallel; the file does not depend on whether or how many threads were used.
+
+enum ImageFormat
+{
+	IMAGE_TGA,
+	IMAGE_TGA_RLE,
+	IMAGE_QOI
+};
+
+const char* imageFormatName(ImageFormat format);  // "tga", "rle" or "qoi"
+bool parseImageFormat(const std::string& name, ImageFormat& format);
+const char* imageExtension(ImageFormat format);  // ".tga" for both targa formats
+
+// DIR/0042_frame.tga: the frame number zero padded to at least digits; an empty dir is the working directory
+std::string frameFileName(const std::string& dir, int frame, int digits, ImageFormat format);
+
+// the whole file in out; out is resized in place, so reusing it for many frames allocates nothing after the first
+void encodeImage(const unsigned char* bgr, int width, int height, ImageFormat format, std::vector<unsigned char>& out,
+	ThreadPool* pool = NULL);
+// encode into buffer and write the file; false if it could not be written
+bool writeImage(const std::string& fileName, const unsigned char* bgr, int width, int height, ImageFormat format,
+	std::vector<unsigned char>& buffer, ThreadPool* pool = NULL);
+
+#endif
@@ -0,0 +1,287 @@
+#include "KinematicMeshCollider.h"
+#include "Geometry.h"
+
+#include <algorithm>
+
+// minimum number of vertices / triangles handed to one task of the thread pool
+static const int VERTEX_GRAIN = 4096;
+static const int TRIANGLE_GRAIN = 2048;
+
+template<class F>
+static void runParallel(ThreadPool* pool, int begin, int end, int grainSize, const F& func)
+{
+	if (pool)
+		pool->parallelFor(begin, end, grainSize, func);
+	else
+		func(begin, end);
+}
+
+KinematicMeshCollider::KinematicMeshCollider(const std::vector<Vec3f>& vertices, const std::vector<Vec3i>& triangles)
+	: _triangles(triangles), _startVertices(vertices), _endVertices(vertices), _vertices(vertices)
+{
+	int numVertices = (int)vertices.size();
+	int numTriangles = (int)triangles.size();
+	_velocities.assign(numVertices, Vec3f(0.0f));
+
+	// edges shared by two triangles get one id: sort the sides of all triangles by their end points
+	struct Side
+	{
+		int lo, hi, slot;  // slot: triangle * 3 + index of the opposite vertex
+		bool operator<(const Side& other) const { return lo < other.lo || (lo == other.lo && hi < other.hi); }
+	};
+	std::vector<Side> sides(3 * numTriangles);
+	for (int t = 0; t < numTriangles; ++t)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			int a = triangles[t][(k + 1) % 3], b = triangles[t][(k + 2) % 3];
+			sides[3 * t + k] = { min(a, b), max(a, b), 3 * t + k };
+		}
+	}
+	std::sort(sides.begin(), sides.end());
+	_triangleEdges.resize(numTriangles);
+	_edgeTriangles.clear();
+	for (size_t s = 0; s < sides.size(); ++s)
+	{
+		int t = sides[s].slot / 3;
+		if (s == 0 || sides[s - 1] < sides[s])
+			_edgeTriangles.push_back(Vec2i(t, -1));
+		else if (_edgeTriangles.back()[1] < 0)
+			_edgeTriangles.back()[1] = t;  // a third triangle on a non-manifold edge is left out of its normal
+		_triangleEdges[t][sides[s].slot % 3] = (int)_edgeTriangles.size() - 1;
+	}
+
+	// triangles around each vertex, for the vertex normals
+	_vertexTriangleOffsets.assign(numVertices + 1, 0);
+	for (int t = 0; t < numTriangles; ++t)
+		for (int k = 0; k < 3; ++k)
+			_vertexTriangleOffsets[triangles[t][k] + 1]++;
+	for (int v = 0; v < numVertices; ++v)
+		_vertexTriangleOffsets[v + 1] += _vertexTriangleOffsets[v];
+	_vertexTriangles.resize(_vertexTriangleOffsets[numVertices]);
+	std::vector<int> slot(_vertexTriangleOffsets.begin(), _vertexTriangleOffsets.end() - 1);
+	for (int t = 0; t < numTriangles; ++t)
+		for (int k = 0; k < 3; ++k)
+			_vertexTriangles[slot[triangles[t][k]]++] = t;
+
+	_triangleBounds.resize(numTriangles);
+	refit(NULL);
+	for (int v = 0; v < numVertices; ++v)
+		_frameBounds.expand(vertices[v]);
+}
+
+void KinematicMeshCollider::setFrame(const std::vector<Vec3f>& vertices, float frameTime, ThreadPool* pool)
+{
+	assert(vertices.size() == _vertices.size());
+	_startVertices = _vertices;
+	_endVertices = vertices;
+	_time = 0.0f;
+	float invFrameTime = frameTime > 0.0f ? 1 / frameTime : 0.0f;
+	runParallel(pool, 0, (int)_vertices.size(), VERTEX_GRAIN, [&](int begin, int end)
+	{
+		for (int v = begin; v < end; ++v)
+			_velocities[v] = (_endVertices[v] - _startVertices[v]) * invFrameTime;
+	});
+	// the vertices move linearly, so the boxes of both ends hold the mesh at any time in between
+	_frameBounds = AABB();
+	float maxMove2 = 0.0f;
+	for (size_t v = 0; v < _vertices.size(); ++v)
+	{
+		_frameBounds.expand(_startVertices[v]);
+		_frameBounds.expand(_endVertices[v]);
+		maxMove2 = max(maxMove2, dist2(_startVertices[v], _endVertices[v]));
+	}
+	_maxMove = sqrt(maxMove2);
+}
+
+void KinematicMeshCollider::setTime(float t, ThreadPool* pool)
+{
+	_time = clamp(t, 0.0f, 1.0f);
+	runParallel(pool, 0, (int)_vertices.size(), VERTEX_GRAIN, [&](int begin, int end)
+	{
+		for (int v = begin; v < end; ++v)
+			_vertices[v] = _startVertices[v] + (_endVertices[v] - _startVertices[v]) * _time;
+	});
+	refit(pool);
+}
+
+void KinematicMeshCollider::refit(ThreadPool* pool)
+{
+	const Vec3f* x = _vertices.data();
+	runParallel(pool, 0, (int)_triangles.size(), TRIANGLE_GRAIN, [&](int begin, int end)
+	{
+		for (int t = begin; t < end; ++t)
+		{
+			AABB box;
+			for (int k = 0; k < 3; ++k)
+				box.expand(x[_triangles[t][k]]);
+			_triangleBounds[t] = box;
+		}
+	});
+	_bvh.update(_triangleBounds, pool);  // builds the first time
+}
+
+Vec3f KinematicMeshCollider::faceNormal(int t) const
+{
+	const Vec3i& tri = _triangles[t];
+	Vec3f n = cross(_vertices[tri[1]] - _vertices[tri[0]], _vertices[tri[2]] - _vertices[tri[0]]);
+	float len = mag(n);
+	return len > M_EPSION ? n / len : Vec3f(0.0f);
+}
+
+Vec3f KinematicMeshCollider::pseudoNormal(int t, const Vec3f& uvw) const
+{
+	int numZeros = (uvw[0] == 0.0f) + (uvw[1] == 0.0f) + (uvw[2] == 0.0f);
+	if (numZeros == 0)
+		return faceNormal(t);
+	if (numZeros == 1)
+	{
+		// on the edge opposite the vertex without weight: both faces of the edge
+		int k = uvw[0] == 0.0f ? 0 : (uvw[1] == 0.0f ? 1 : 2);
+		const Vec2i& tris = _edgeTriangles[_triangleEdges[t][k]];
+		return tris[1] < 0 ? faceNormal(tris[0]) : faceNormal(tris[0]) + faceNormal(tris[1]);
+	}
+
+	// on a vertex: all faces around it, each weighted by its angle at the vertex
+	int v = _triangles[t][uvw[0] != 0.0f ? 0 : (uvw[1] != 0.0f ? 1 : 2)];
+	Vec3f sum(0.0f);
+	for (int n = _vertexTriangleOffsets[v]; n < _vertexTriangleOffsets[v + 1]; ++n)
+	{
+		int u = _vertexTriangles[n];
+		const Vec3i& tri = _triangles[u];
+		int k = tri[0] == v ? 0 : (tri[1] == v ? 1 : 2);
+		Vec3f e1 = _vertices[tri[(k + 1) % 3]] - _vertices[v];
+		Vec3f e2 = _vertices[tri[(k + 2) % 3]] - _vertices[v];
+		float len = mag(e1) * mag(e2);
+		if (len > M_EPSION)
+			sum += faceNormal(u) * std::acos(clamp(dot(e1, e2) / len, -1.0f, 1.0f));
+	}
+	return sum;
+}
+
+int KinematicMeshCollider::closestTriangle(const Vec3f& p, float maxDist2, Vec3f& closest, Vec3f& uvw) const
+{
+	const Vec3f* x = _vertices.data();
+	int best = _bvh.nearest(p, maxDist2, [&](int t)
+	{
+		const Vec3i& tri = _triangles[t];
+		return mag2(p - closestPointOnTriangle(p, x[tri[0]], x[tri[1]], x[tri[2]]));
+	});
+	if (best >= 0)
+	{
+		const Vec3i& tri = _triangles[best];
+		closest = closestPointOnTriangle(p, x[tri[0]], x[tri[1]], x[tri[2]], uvw);
+	}
+	return best;
+}
+
+float KinematicMeshCollider::signedDistance(const Vec3f& p, int t, const Vec3f& closest, const Vec3f& uvw, Vec3f& normal) const
+{
+	Vec3f pseudo = pseudoNormal(t, uvw);
+	Vec3f d = p - closest;
+	float dist = mag(d);
+	float sign = dot(d, pseudo) < 0.0f ? -1.0f : 1.0f;
+	if (dist > M_EPSION)
+		normal = d * (sign / dist);
+	else
+		normal = mag2(pseudo) > 0.0f ? normalized(pseudo) : Vec3f(0.0f, 1.0f, 0.0f);  // on the surface
+	return sign * dist;
+}
+
+float KinematicMeshCollider::signedDistance(const Vec3f& p, Vec3f& normal) const
+{
+	Vec3f closest, uvw;
+	int t = closestTriangle(p, 1e30f, closest, uvw);
+	if (t >= 0)
+		return signedDistance(p, t, closest, uvw, normal);
+	normal = Vec3f(0.0f, 1.0f, 0.0f);  // empty mesh
+	return 1e30f;
+}
+
+float KinematicMeshCollider::boundedDistance(const Vec3f& p, float maxDistance, Vec3f& normal) const
+{
+	Vec3f surfaceVelocity;
+	return contactDistance(p, maxDistance, normal, surfaceVelocity);
+}
+
+float KinematicMeshCollider::contactDistance(const Vec3f& p, float maxDistance, Vec3f& normal, Vec3f& surfaceVelocity) const
+{
+	// a search from far away has to look at many triangles about as far as the closest one; only the near
+	// ones matter here
+	Vec3f closest, uvw;
+	int t = closestTriangle(p, sqr(maxDistance), closest, uvw);
+	if (t < 0)
+	{
+		if (!_bvh.bounds().contains(p) || !inside(p))
+		{
+			normal = Vec3f(0.0f, 1.0f, 0.0f);
+			surfaceVelocity = Vec3f(0.0f);
+			return maxDistance;
+		}
+		t = closestTriangle(p, 1e30f, closest, uvw);  // deep inside, the way out is needed
+	}
+	surfaceVelocity = velocityAt(t, uvw);
+	return signedDistance(p, t, closest, uvw, normal);
+}
+
+bool KinematicMeshCollider::inside(const Vec3f& p) const
+{
+	const Vec3f* x = _vertices.data();
+	AABB ray(p, Vec3f(_bvh.bounds().hi[0], p[1], p[2]));
+	int crossings = 0;
+	_bvh.query(ray, [&](int t)
+	{
+		const Vec3i& tri = _triangles[t];
+		float cross;
+		if (crossTriangleX(p[1], p[2], x[tri[0]], x[tri[1]], x[tri[2]], cross) && cross > p[0])
+			crossings++;
+	});
+	return crossings % 2 == 1;
+}
+
+bool KinematicMeshCollider::raycast(const Vec3f& from, const Vec3f& to, float& t, Vec3f& normal) const
+{
+	const Vec3f* x = _vertices.data();
+	Vec3f dir = to - from;
+	AABB path;
+	path.expand(from);
+	path.expand(to);
+	bool hit = false;
+	t = 1.0f;
+	_bvh.query(path, [&](int tri)
+	{
+		const Vec3f& a = x[_triangles[tri][0]];
+		const Vec3f& b = x[_triangles[tri][1]];
+		const Vec3f& c = x[_triangles[tri][2]];
+		Vec3f n = cross(b - a, c - a);
+		float along = dot(dir, n);
+		if (along >= 0.0f)
+			return;  // leaving through the triangle, or parallel to it
+		float s = dot(a - from, n) / along;
+		if (s < 0.0f || s > t)
+			return;
+		// inside all three edges, seen along n
+		Vec3f q = from + dir * s;
+		if (dot(cross(b - a, q - a), n) < 0.0f || dot(cross(c - b, q - b), n) < 0.0f || dot(cross(a - c, q - c), n) < 0.0f)
+			return;
+		t = s;
+		normal = normalized(n);
+		hit = true;
+	});
+	return hit;
+}
+
+Vec3f KinematicMeshCollider::velocity(const Vec3f& p) const
+{
+	Vec3f closest, uvw;
+	int t = closestTriangle(p, sqr(_maxMove), closest, uvw);
+	if (t < 0)
+		return Vec3f(0.0f);
+	return velocityAt(t, uvw);
+}
+
+Vec3f KinematicMeshCollider::velocityAt(int t, const Vec3f& uvw) const
+{
+	const Vec3i& tri = _triangles[t];
+	return _velocities[tri[0]] * uvw[0] + _velocities[tri[1]] * uvw[1] + _velocities[tri[2]] * uvw[2];
+}
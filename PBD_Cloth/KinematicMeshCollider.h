@@ -0,0 +1,67 @@
+#ifndef KINEMATICMESHCOLLIDER_H
+#define KINEMATICMESHCOLLIDER_H
+
+#include <vector>
+#include "Collider.h"
+#include "BVH.h"
+#include "ThreadPool.h"
+
+// A triangle mesh animated from outside, e.g. a skinned character. The triangles never change; setFrame()
+// hands over the vertices of the next animation frame and setTime() places the mesh between the last two
+// frames by linear interpolation, so the substeps of a frame see it move smoothly, at the constant velocity
+// velocity() reports. Distances are looked up in a BVH over the triangles that setTime() refits to the
+// interpolated vertices, in parallel; it is only rebuilt if refitting degraded it too much. The sign comes
+// from the angle weighted pseudo normal (Baerentzen and Aanaes 2005) of the closest feature, so the mesh
+// should be closed and its triangles counterclockwise seen from outside.
+class KinematicMeshCollider : public Collider
+{
+public:
+	KinematicMeshCollider(const std::vector<Vec3f>& vertices, const std::vector<Vec3i>& triangles);
+
+	// start a frame at the current vertices that reaches these ones frameTime later; time() goes back to 0.
+	// The swept bounds change, so the ColliderSet holding the mesh needs a build() afterwards
+	void setFrame(const std::vector<Vec3f>& vertices, float frameTime, ThreadPool* pool = NULL);
+	void setTime(float t, ThreadPool* pool = NULL);  // 0: start of the frame, 1: the vertices given to setFrame()
+	float time() const { return _time; }
+	const std::vector<Vec3f>& vertices() const { return _vertices; }  // at the current time
+	const std::vector<Vec3i>& triangles() const { return _triangles; }
+	int buildCount() const { return _bvh.buildCount(); }
+
+	AABB bounds() const { return _frameBounds; }  // swept over the whole frame
+	float signedDistance(const Vec3f& p, Vec3f& normal) const;
+	// only searches the triangles within maxDistance; without any, a ray tells whether p is inside
+	float boundedDistance(const Vec3f& p, float maxDistance, Vec3f& normal) const;
+	float contactDistance(const Vec3f& p, float maxDistance, Vec3f& normal, Vec3f& surfaceVelocity) const;
+	// first triangle the segment crosses from its front side; starting inside does not count as a hit by itself
+	bool raycast(const Vec3f& from, const Vec3f& to, float& t, Vec3f& normal) const;
+	// 0 for points farther from the mesh than any vertex moves during the frame, which it cannot reach
+	Vec3f velocity(const Vec3f& p) const;
+
+private:
+	std::vector<Vec3i> _triangles;
+	std::vector<Vec3i> _triangleEdges;  // edge k of a triangle lies opposite its vertex k
+	std::vector<Vec2i> _edgeTriangles;  // the one or two triangles of each edge, -1 for a missing second one
+	std::vector<int> _vertexTriangleOffsets;  // triangles of vertex v are _vertexTriangles[offsets[v], offsets[v+1])
+	std::vector<int> _vertexTriangles;
+	std::vector<Vec3f> _startVertices, _endVertices;  // of the current frame
+	std::vector<Vec3f> _vertices;  // at _time
+	std::vector<Vec3f> _velocities;  // of each vertex over the current frame
+	std::vector<AABB> _triangleBounds;  // at _time
+	AABB _frameBounds;
+	float _maxMove = 0.0f;  // longest way a vertex moves during the frame
+	BVH _bvh;
+	float _time = 1.0f;
+
+	void refit(ThreadPool* pool);
+	Vec3f faceNormal(int t) const;  // unit length, 0 for a degenerate triangle
+	// pseudo normal of the face, edge or vertex of triangle t the barycentric coordinates uvw lie on; not normalized
+	Vec3f pseudoNormal(int t, const Vec3f& uvw) const;
+	// the triangle closest to p with the barycentric coordinates of its closest point; -1 if there is none
+	// within sqrt(maxDist2)
+	int closestTriangle(const Vec3f& p, float maxDist2, Vec3f& closest, Vec3f& uvw) const;
+	float signedDistance(const Vec3f& p, int t, const Vec3f& closest, const Vec3f& uvw, Vec3f& normal) const;
+	Vec3f velocityAt(int t, const Vec3f& uvw) const;  // surface velocity at the barycentric coordinates uvw of triangle t
+	bool inside(const Vec3f& p) const;  // from the parity of the crossings of a ray along +x
+};
+
+#endif
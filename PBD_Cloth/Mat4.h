@@ -0,0 +1,97 @@
+#ifndef MAT4_H
+#define MAT4_H
+
+#include <cmath>
+#include "Vec.h"
+
+// 4x4 float matrix for the transforms of the GL-free renderer, laid out and built like glm's mat4: stored by
+// columns, m[c][r], and perspective()/lookAt() give the same matrices as glm::perspective()/glm::lookAt() with
+// a right handed eye space and depth from -1 to 1, so a scene looks the same in the viewer and in software.
+struct Mat4
+{
+	float m[4][4];
+
+	Mat4() { *this = diagonal(1.0f); }
+
+	static Mat4 diagonal(float d)
+	{
+		Mat4 result(0);
+		for (int k = 0; k < 4; ++k)
+			result.m[k][k] = d;
+		return result;
+	}
+
+	static Mat4 translation(const Vec3f& t)
+	{
+		Mat4 result;
+		for (int k = 0; k < 3; ++k)
+			result.m[3][k] = t[k];
+		return result;
+	}
+
+	static Mat4 scaling(const Vec3f& s)
+	{
+		Mat4 result;
+		for (int k = 0; k < 3; ++k)
+			result.m[k][k] = s[k];
+		return result;
+	}
+
+	static Mat4 perspective(float fovy, float aspect, float zNear, float zFar)  // fovy in radians
+	{
+		float f = 1 / std::tan(fovy / 2);
+		Mat4 result(0);
+		result.m[0][0] = f / aspect;
+		result.m[1][1] = f;
+		result.m[2][2] = -(zFar + zNear) / (zFar - zNear);
+		result.m[2][3] = -1.0f;
+		result.m[3][2] = -(2 * zFar * zNear) / (zFar - zNear);
+		return result;
+	}
+
+	static Mat4 lookAt(const Vec3f& eye, const Vec3f& center, const Vec3f& up)
+	{
+		Vec3f f = normalized(center - eye);
+		Vec3f s = normalized(cross(f, up));
+		Vec3f u = cross(s, f);
+		Mat4 result;
+		for (int c = 0; c < 3; ++c)
+		{
+			result.m[c][0] = s[c];
+			result.m[c][1] = u[c];
+			result.m[c][2] = -f[c];
+		}
+		result.m[3][0] = -dot(s, eye);
+		result.m[3][1] = -dot(u, eye);
+		result.m[3][2] = dot(f, eye);
+		return result;
+	}
+
+	Mat4 operator*(const Mat4& other) const
+	{
+		Mat4 result(0);
+		for (int c = 0; c < 4; ++c)
+			for (int r = 0; r < 4; ++r)
+				for (int k = 0; k < 4; ++k)
+					result.m[c][r] += m[k][r] * other.m[c][k];
+		return result;
+	}
+
+	Vec4f transform(const Vec3f& p) const  // of the point (p, 1)
+	{
+		Vec4f result;
+		for (int r = 0; r < 4; ++r)
+			result[r] = m[0][r] * p[0] + m[1][r] * p[1] + m[2][r] * p[2] + m[3][r];
+		return result;
+	}
+
+private:
+	explicit Mat4(int)
+	{
+		for (int c = 0; c < 4; ++c)
+			for (int r = 0; r < 4; ++r)
+				m[c][r] = 0.0f;
+	}
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include "MeshIO.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+bool loadObj(const char* fileName, std::vector<Vec3f>& vertices, std::vector<Vec3i>& triangles)
+{
+	FILE* pFile = fopen(fileName, "r");
+	if (pFile == NULL)
+		return false;
+
+	vertices.clear();
+	triangles.clear();
+	bool ok = true;
+	char line[1024];
+	std::vector<int> face;
+	while (ok && fgets(line, sizeof(line), pFile) != NULL)
+	{
+		if (line[0] == 'v' && line[1] == ' ')
+		{
+			Vec3f v;
+			if (sscanf(line + 2, "%f %f %f", &v[0], &v[1], &v[2]) != 3)
+				ok = false;
+			vertices.push_back(v);
+		}
+		else if (line[0] == 'f' && line[1] == ' ')
+		{
+			// "f 1 2 3", "f 1/1 2/2 3/3", "f 1//1 ..." or "f 1/1/1 ..."; negative indices count from the end
+			face.clear();
+			for (char* token = strtok(line + 2, " \t\r\n"); token != NULL; token = strtok(NULL, " \t\r\n"))
+			{
+				int index = atoi(token);
+				index = index < 0 ? (int)vertices.size() + index : index - 1;
+				if (index < 0 || index >= (int)vertices.size())
+				{
+					ok = false;
+					break;
+				}
+				face.push_back(index);
+			}
+			for (int k = 2; ok && k < (int)face.size(); ++k)
+				triangles.push_back(Vec3i(face[0], face[k - 1], face[k]));
+		}
+	}
+	ok = ok && !ferror(pFile);
+	fclose(pFile);
+	return ok;
+}
@@ -0,0 +1,12 @@
+#ifndef MESHIO_H
+#define MESHIO_H
+
+#include <vector>
+#include "Vec.h"
+
+// Read the vertices and faces of a wavefront obj file; polygons are split into triangle fans.
+// Texture coordinates, normals, groups and materials are ignored.
+// Returns false if the file could not be read or a face refers to a missing vertex.
+bool loadObj(const char* fileName, std::vector<Vec3f>& vertices, std::vector<Vec3i>& triangles);
+
+#endif
@@ -9,8 +9,18 @@
 #include "Util.h"
 #include "Vec.h"
 #include "Cloth.h"
-
+#include "BoundedQueue.h"
+#include "FrameCapture.h"
+#include "ImageWriter.h"
+#include "SphereMesh.h"
+#include "TripleBuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <thread>
 
 // simulation settings
 int maxFrames = 240;
@@ -19,6 +29,20 @@ float FPS = 24.0f;
 float timeStep = 1.0f / (FPS*maxSubstep); //1.0/240f;
 int solverIteration = 10;
 float dampingRate = 0.9f;
+int maxCatchUpSteps = 4 * maxSubstep;  // substeps simulated at most in one go when the simulation runs behind the clock
+
+// frame capture: every simulated frame is saved as captureDir/NNNN_frame.tga (or .qoi)
+std::string captureDir;  // empty: the working directory
+ImageFormat captureFormat = IMAGE_TGA_RLE;
+int captureDigits = 4;  // frame numbers are zero padded to this many digits
+#define CAPTURE_QUEUE_FRAMES 48  // completed frames waiting to be saved; the simulation only waits once this many are
+
+// what the simulation thread hands to the render thread
+struct ClothSnapshot
+{
+	std::vector<Vec3f> pos;
+	int step;  // substeps simulated so far
+};
 
 // OpenGL functions
 // void copyVertices(Cloth& newCloth);
@@ -26,16 +50,42 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
-GLint gltWriteTGA(const char *szFileName);
-void setCloth(Cloth newCloth, unsigned int VAO_1, unsigned int VBO_1, unsigned int EBO);
-void setSphere(unsigned int VAO_2);
-void renderCloth(Cloth newCloth, unsigned int VAO_1, unsigned int VBO_1, unsigned int EBO);
-void renderSphere(unsigned int VAO_2);
+
+// GL buffers of the cloth mesh. The triangle indices never change and are uploaded once; only the packed
+// positions are streamed, when a snapshot that is not in the buffer yet is drawn, and redrawn as they are
+// otherwise. With GL 4.4 the position buffer is persistently mapped with room for CLOTH_BUFFER_REGIONS copies
+// that are written round robin, each behind a fence of the draw that last read it; older contexts orphan the
+// buffer instead. Either way the upload does not wait for the previous draw.
+#define CLOTH_BUFFER_REGIONS 3
+struct ClothBuffers
+{
+	unsigned int VAO = 0, VBO = 0, EBO = 0;
+	int numPoints = 0;
+	int numIndices = 0;
+	Vec3f* mapped = NULL;  // persistent mapping of all regions; NULL: orphaning
+	int region = CLOTH_BUFFER_REGIONS - 1;  // region written last
+	int uploadedStep = -1;  // ClothSnapshot::step of the positions in it
+	GLsync fences[CLOTH_BUFFER_REGIONS] = {};
+};
+void setCloth(const Cloth& cloth, ClothBuffers& buffers);  // create the buffers and upload the indices
+void renderCloth(const ClothSnapshot& snapshot, ClothBuffers& buffers);  // upload the positions if they are new, and draw
+void deleteCloth(ClothBuffers& buffers);
+
+// GL buffers of a mesh that never changes, drawn once per instance with the model matrix of the instance.
+// The vertices and indices are uploaded once, into immutable storage with GL 4.4; the instance matrices sit in
+// a buffer of maxInstances that is only rewritten when they change, and every instance goes in one draw call.
+struct StaticMesh
+{
+	unsigned int VAO = 0, VBO = 0, EBO = 0, instanceVBO = 0;
+	int numIndices = 0;
+	int numInstances = 0, maxInstances = 0;
+};
+void setStaticMesh(const std::vector<Vec3f>& vertices, const std::vector<unsigned int>& indices, int maxInstances, StaticMesh& mesh);
+void setInstances(const std::vector<glm::mat4>& models, StaticMesh& mesh);  // at most maxInstances
+void renderInstances(const StaticMesh& mesh);
+void deleteStaticMesh(StaticMesh& mesh);
 
 // object for demoing collision
-#define SPHERE_VEC 3888
-void drawSphere();
-float sphereVertices[SPHERE_VEC * 3];
 Vec3f spherePos(0.0f, 0.0f, 0.0f);
 float sphereRadius = 5.0f;
 
@@ -66,8 +116,24 @@ const float DIST_K_STIFF = 1;   // stiffness of the distance constraint
 bool hasPosConstraint = true;  // true: fix the top left and right points; false: don't fix
 float angle = -90.0f;
 
-int main()
+int main(int argc, char** argv)
 {
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--out" && i + 1 < argc)
+			captureDir = argv[++i];
+		else if (arg == "--image-format" && i + 1 < argc && parseImageFormat(argv[++i], captureFormat))
+			continue;
+		else
+		{
+			printf("usage: %s [--out DIR] [--image-format tga|rle|qoi]\n", argv[0]);
+			printf("  saves every simulated frame to DIR/NNNN_frame.tga or .qoi; rle: run length encoded targa (default %s)\n",
+				imageFormatName(captureFormat));
+			return arg == "--help" ? 0 : -1;
+		}
+	}
+
 	// glfw: initialize and configure
 	// ------------------------------
 	glfwInit();
@@ -89,6 +155,7 @@ int main()
 		return -1;
 	}
 	glfwMakeContextCurrent(window);
+	glfwSwapInterval(1);  // present at display rate; the simulation runs on its own thread
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 	glfwSetScrollCallback(window, scroll_callback);
 
@@ -110,31 +177,38 @@ int main()
 	// build and compile our shader zprogram
 	// ------------------------------------
 	Shader myShader("shader.vs", "shader.fs");
+	Shader instancedShader("instanced.vs", "shader.fs");
 
 	// create cloth obj
 	Vec3f clothPos(-10.0f, 10.0f, -20.0f);  // tranlate to the center
 	Cloth newCloth(resX, resY, sizeX, sizeY, DIST_K_STIFF, hasPosConstraint, clothPos);
+	newCloth.colliders = std::make_shared<ColliderSet>();
+	newCloth.colliders->add(std::make_shared<SphereCollider>(spherePos, sphereRadius));
 	// printf("new cloth: %d, %d, %f, %f", resX, resY, sizeX, sizeY);
 	
 
 	// set up vertex data (and buffer(s)) and configure vertex attributes
 	// --------------------------
-	drawSphere();
-
-	unsigned int VBO_1, VBO_2, VAO_1, VAO_2, EBO;
-	glGenVertexArrays(1, &VAO_1);
-	glGenVertexArrays(2, &VAO_2);
-	glGenBuffers(1, &VBO_1);
-	glGenBuffers(2, &VBO_2);
-	glGenBuffers(1, &EBO);
-
 	// cloth settings
-	setCloth(newCloth, VAO_1, VBO_1, EBO);
-	glEnableVertexAttribArray(0);
+	ClothBuffers clothBuffers;
+	setCloth(newCloth, clothBuffers);
 
-	//// sphere settings
-	setSphere(VAO_2);
-	glEnableVertexAttribArray(0);
+	// sphere settings: one instance per sphere collider
+	std::vector<glm::mat4> sphereModels;
+	for (int c = 0; c < newCloth.colliders->size(); ++c)
+	{
+		const SphereCollider* sphere = dynamic_cast<const SphereCollider*>(&(*newCloth.colliders)[c]);
+		if (!sphere)
+			continue;
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(sphere->center[0], sphere->center[1], sphere->center[2]));
+		sphereModels.push_back(glm::scale(model, glm::vec3(sphere->radius)));
+	}
+	std::vector<Vec3f> sphereVertices;
+	std::vector<unsigned int> sphereIndices;
+	sphereMesh(sphereVertices, sphereIndices);
+	StaticMesh sphereBuffers;
+	setStaticMesh(sphereVertices, sphereIndices, (int)sphereModels.size(), sphereBuffers);
+	setInstances(sphereModels, sphereBuffers);
 
 	//// tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
 	//// -------------------------------------------------------------------------------------------
@@ -144,78 +218,130 @@ int main()
 
 	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-	// render loop
-	// -----------
-	
-	//while (!glfwWindowShouldClose(window))
-	//{	
-		for (int frameNum = 1; frameNum <= maxFrames; ++frameNum)
+	// simulation thread: steps the cloth in fixed substeps of timeStep, as many as the wall clock asks for, and
+	// publishes a copy of the positions after each batch for display. Every frame is saved, so the positions at
+	// the end of each frame also go into a queue of frames to capture; only when that is full does it wait.
+	TripleBuffer<ClothSnapshot> snapshots(ClothSnapshot{ newCloth.points.pos, 0 });
+	BoundedQueue<ClothSnapshot> captureQueue(CAPTURE_QUEUE_FRAMES);
+	std::atomic<bool> quit(false), simDone(false);
+	std::thread simThread([&]()
+	{
+		typedef std::chrono::steady_clock Clock;
+		int numSteps = maxFrames * maxSubstep;
+		int step = 0;
+		double accumulator = 0.0;  // wall clock seconds not simulated yet
+		Clock::time_point last = Clock::now();
+		while (!quit && step < numSteps)
 		{
-			for(int substep = 1; substep <= maxSubstep; ++substep)
+			Clock::time_point now = Clock::now();
+			accumulator += std::chrono::duration<double>(now - last).count();
+			last = now;
+			// too slow for real time: fall behind the clock instead of taking more and more steps to catch up
+			accumulator = min(accumulator, (double)maxCatchUpSteps * timeStep);
+			if (accumulator < timeStep)
+			{
+				std::this_thread::sleep_for(std::chrono::duration<double>(timeStep - accumulator));
+				continue;
+			}
+			while (!quit && accumulator >= timeStep && step < numSteps)
 			{
-				// per-frame time logic
-				// --------------------
-				float currentFrame = glfwGetTime();
-				deltaTime = currentFrame - lastFrame;
-				lastFrame = currentFrame;
-
 				// update cloth state; Physics simulation using fixed deltatime
-				newCloth.update(timeStep, dampingRate, hasPosConstraint, solverIteration, spherePos, sphereRadius);
-				// input
-				// -----
-				processInput(window);
-
-				// render
-				// ------
-				glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-				// activate shader
-				myShader.use();
-
-				// pass projection matrix to shader (note that in this case it could change every frame)
-				glm::mat4 projection = glm::perspective(glm::radians(fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-				myShader.setMat4("projection", projection);
-
-				// camera/view transformation
-				glm::mat4 view = glm::lookAt(cameraPos,
-								glm::vec3(0.0f, 0.0f, 0.0f),
-								cameraUp);
-				myShader.setMat4("view", view);
-
-				// model transformation
-				glm::mat4 model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-				myShader.setMat4("model", model);
-
-				// render cloth
-				renderCloth(newCloth, VAO_1, VBO_1, EBO);
-
-				// render sphere
-				glm::mat4 model_s = glm::mat4(1.0f);
-				model_s = glm::scale(model_s, glm::vec3(5.0f, 5.0f, 5.0f));
-				model_s = glm::translate(model_s, glm::vec3(spherePos[0], spherePos[1], spherePos[2]));
-				myShader.setMat4("model", model_s);
-				renderSphere(VAO_2);
-
-				// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-				// -------------------------------------------------------------------------------
-				glfwSwapBuffers(window);
-				glfwPollEvents();
+				newCloth.update(timeStep, dampingRate, hasPosConstraint, solverIteration);
+				accumulator -= timeStep;
+				++step;
+				if (step % maxSubstep == 0)
+					captureQueue.push(ClothSnapshot{ newCloth.points.pos, step });
 			}
-			// save each frame as a targa file
-			std::string fileName = std::to_string(frameNum) + "_frame.tga";
-			const char * c = fileName.c_str();
-			if(gltWriteTGA(c))
-				printf("saving %d sucess!\n", frameNum);
+			ClothSnapshot& snapshot = snapshots.back();
+			snapshot.pos = newCloth.points.pos;
+			snapshot.step = step;
+			snapshots.publish();
 		}
-	//}
+		simDone = true;
+	});
+
+	// render loop: draws the latest snapshot at display rate until the simulation is done
+	// -----------
+	std::unique_ptr<FrameCapture> capture(new FrameCapture(captureFormat));  // needs the context, released before it goes
+	ClothSnapshot frame;
+	while (!glfwWindowShouldClose(window))
+	{
+		// per-frame time logic
+		// --------------------
+		float currentFrame = glfwGetTime();
+		deltaTime = currentFrame - lastFrame;
+		lastFrame = currentFrame;
+
+		// input
+		// -----
+		processInput(window);
+
+		// read before taking the snapshot: once the simulation is done, its last frames are queued
+		bool finished = simDone;
+		snapshots.update();
+		const ClothSnapshot& snapshot = snapshots.front();
+
+		// pass projection matrix to shader (note that in this case it could change every frame)
+		glm::mat4 projection = glm::perspective(glm::radians(fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+
+		// camera/view transformation
+		glm::mat4 view = glm::lookAt(cameraPos,
+						glm::vec3(0.0f, 0.0f, 0.0f),
+						cameraUp);
+
+		// render
+		// ------
+		auto drawScene = [&](const ClothSnapshot& cloth)
+		{
+			glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			// activate shader
+			myShader.use();
+			myShader.setMat4("projection", projection);
+			myShader.setMat4("view", view);
+
+			// model transformation
+			glm::mat4 model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
+			myShader.setMat4("model", model);
+
+			// render cloth
+			renderCloth(cloth, clothBuffers);
+
+			// render spheres
+			instancedShader.use();
+			instancedShader.setMat4("projection", projection);
+			instancedShader.setMat4("view", view);
+			renderInstances(sphereBuffers);
+		};
+
+		// save the frames completed since the last time, each drawn on its own into the back buffer, which is
+		// read back and written in the background; the displayed snapshot is drawn over them afterwards
+		while (captureQueue.tryPop(frame))
+		{
+			drawScene(frame);
+			capture->capture(frameFileName(captureDir, frame.step / maxSubstep, captureDigits, captureFormat));
+		}
+		drawScene(snapshot);
+
+		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+		// -------------------------------------------------------------------------------
+		glfwSwapBuffers(window);
+		glfwPollEvents();
+		if (finished)
+			break;
+	}
+	quit = true;
+	captureQueue.close();
+	simThread.join();
+	capture->finish();
+	printf("saved %d frames\n", capture->written());
+	capture.reset();
 
 	// optional: de-allocate all resources once they've outlived their purpose:
 	// ------------------------------------------------------------------------
-	glDeleteVertexArrays(1, &VAO_1);
-	glDeleteBuffers(1, &VBO_1);
-	glDeleteVertexArrays(1, &VAO_2);
-	glDeleteBuffers(1, &VBO_2);
+	deleteCloth(clothBuffers);
+	deleteStaticMesh(sphereBuffers);
 
 	// glfw: terminate, clearing all previously allocated GLFW resources.
 	// ------------------------------------------------------------------
@@ -299,195 +425,155 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 		fov = 45.0f;
 }
 
-void drawSphere() {
-	int k = 0;
-	//sphere
-	// phi = degree of angle
-	float DegreesToRadians = M_PI / 180.0;
-	for (float phi = -90.0; phi < 90.0; phi += 10.0)
+// fill the buffer bound to target once: immutable storage with GL 4.4, which only takes glBufferSubData() if flags
+// has GL_DYNAMIC_STORAGE_BIT, or else a buffer that is never reallocated
+void setStaticBuffer(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags)
+{
+	if (GLAD_GL_VERSION_4_4)
+		glBufferStorage(target, size, data, flags);
+	else
+		glBufferData(target, size, data, (flags & GL_DYNAMIC_STORAGE_BIT) ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+}
+
+void setCloth(const Cloth& cloth, ClothBuffers& buffers)
+{
+	buffers.numPoints = cloth.points.size();
+	buffers.numIndices = (int)cloth.indexArray.size();
+	glGenVertexArrays(1, &buffers.VAO);
+	glGenBuffers(1, &buffers.VBO);
+	glGenBuffers(1, &buffers.EBO);
+	glBindVertexArray(buffers.VAO);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.EBO);
+	setStaticBuffer(GL_ELEMENT_ARRAY_BUFFER, sizeof(cloth.indexArray[0]) * buffers.numIndices, cloth.indexArray.data(), 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
+	GLsizeiptr regionSize = sizeof(Vec3f) * buffers.numPoints;
+	if (GLAD_GL_VERSION_4_4)
 	{
-		// the <math.h>'s sin, cos, and tan work with radians only.
-		// In each loop, draw two triangle
-		float phiR = phi * DegreesToRadians;
-		float phiR10 = (phi + 10) * DegreesToRadians;
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, regionSize * CLOTH_BUFFER_REGIONS, NULL, flags);
+		buffers.mapped = (Vec3f*)glMapBufferRange(GL_ARRAY_BUFFER, 0, regionSize * CLOTH_BUFFER_REGIONS, flags);
+	}
+	else
+		glBufferData(GL_ARRAY_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vec3f), (void*)0);
+	glEnableVertexAttribArray(0);
+}
 
-		for (float theta = -180.0; theta < 180.0; theta += 10.0)
+void renderCloth(const ClothSnapshot& snapshot, ClothBuffers& buffers)
+{
+	glBindVertexArray(buffers.VAO);
+	GLsizeiptr regionSize = sizeof(Vec3f) * buffers.numPoints;
+	// positions of the same step are the same positions: draw them again from where they are
+	bool upload = snapshot.step != buffers.uploadedStep;
+	buffers.uploadedStep = snapshot.step;
+	if (buffers.mapped)
+	{
+		if (upload)
+			buffers.region = (buffers.region + 1) % CLOTH_BUFFER_REGIONS;
+		// the region is free once the draw that read it last has finished; a redraw only replaces that fence
+		GLsync& fence = buffers.fences[buffers.region];
+		if (fence)
 		{
-			float thetaR = theta * DegreesToRadians;
-			float thetaR10 = (theta + 10) * DegreesToRadians;
-			// In every square
-			// A1 - B1
-			// | \  |
-			// |  \ |
-			// A2 - B2
-
-			// A1
-			sphereVertices[k+0] = sin(thetaR)*cos(phiR);
-			sphereVertices[k+1] = cos(thetaR)*cos(phiR);
-			sphereVertices[k+2] = sin(phiR);
-			k += 3;
-			// B1
-			sphereVertices[k+0] = sin(thetaR)*cos(phiR10);
-			sphereVertices[k+1] = cos(thetaR)*cos(phiR10);
-			sphereVertices[k+2] = sin(phiR10);
-			k += 3;
-			// B2
-			sphereVertices[k+0] = sin(thetaR10)*cos(phiR10);
-			sphereVertices[k+1] = cos(thetaR10)*cos(phiR10);
-			sphereVertices[k+2] = sin(phiR10);
-			k += 3;
-			// B2
-			sphereVertices[k+0] = sphereVertices[k - 3 + 0];
-			sphereVertices[k+1] = sphereVertices[k - 3 + 1];
-			sphereVertices[k+2] = sphereVertices[k - 3 + 2];
-			k += 3;
-			// A2		   
-			sphereVertices[k+0] = sin(thetaR10)*cos(phiR);
-			sphereVertices[k+1] = cos(thetaR10)*cos(phiR);
-			sphereVertices[k+2] = sin(phiR);
-			k += 3;
-			// A1		   
-			sphereVertices[k+0] = sphereVertices[k - 15 + 0];
-			sphereVertices[k+1] = sphereVertices[k - 15 + 1];
-			sphereVertices[k+2] = sphereVertices[k - 15 + 2];
-			k += 3;
+			if (upload)
+			{
+				while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+					;
+			}
+			glDeleteSync(fence);
+		}
+		int first = buffers.region * buffers.numPoints;
+		if (upload)
+			memcpy(buffers.mapped + first, snapshot.pos.data(), regionSize);
+		glDrawElementsBaseVertex(GL_TRIANGLES, buffers.numIndices, GL_UNSIGNED_INT, 0, first);
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	else
+	{
+		if (upload)
+		{
+			// orphan the storage the last draw may still read, then fill a fresh one
+			glBindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
+			glBufferData(GL_ARRAY_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, regionSize, snapshot.pos.data());
 		}
+		glDrawElements(GL_TRIANGLES, buffers.numIndices, GL_UNSIGNED_INT, 0);
 	}
-	assert(SPHERE_VEC * 3);
 }
 
-void setCloth(Cloth newCloth, unsigned int VAO_1, unsigned int VBO_1, unsigned int EBO)
+void deleteCloth(ClothBuffers& buffers)
 {
-	glBindVertexArray(VAO_1);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO_1);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(newCloth.points[0])*newCloth.points.size(), &newCloth.points[0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(newCloth.indexArray[0])*newCloth.indexArray.size(), &newCloth.indexArray[0], GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(newCloth.points[0]), (void*)0);
+	for (int r = 0; r < CLOTH_BUFFER_REGIONS; ++r)
+	{
+		if (buffers.fences[r])
+			glDeleteSync(buffers.fences[r]);
+		buffers.fences[r] = 0;
+	}
+	if (buffers.mapped)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		buffers.mapped = NULL;
+	}
+	glDeleteVertexArrays(1, &buffers.VAO);
+	glDeleteBuffers(1, &buffers.VBO);
+	glDeleteBuffers(1, &buffers.EBO);
 }
 
-void renderCloth(Cloth newCloth, unsigned int VAO_1, unsigned int VBO_1, unsigned int EBO)
+void setStaticMesh(const std::vector<Vec3f>& vertices, const std::vector<unsigned int>& indices, int maxInstances, StaticMesh& mesh)
 {
-	setCloth(newCloth, VAO_1, VBO_1, EBO);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(newCloth.points[0]), (void*)0);
-	glDrawElements(GL_TRIANGLES, newCloth.indexArray.size(), GL_UNSIGNED_INT, 0);
+	mesh.numIndices = (int)indices.size();
+	mesh.numInstances = 0;
+	mesh.maxInstances = maxInstances;
+	glGenVertexArrays(1, &mesh.VAO);
+	glGenBuffers(1, &mesh.VBO);
+	glGenBuffers(1, &mesh.EBO);
+	glGenBuffers(1, &mesh.instanceVBO);
+	glBindVertexArray(mesh.VAO);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
+	setStaticBuffer(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0]) * indices.size(), indices.data(), 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+	setStaticBuffer(GL_ARRAY_BUFFER, sizeof(vertices[0]) * vertices.size(), vertices.data(), 0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vec3f), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	// a mat4 attribute takes the four locations from 1, one column each, and advances once per instance
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.instanceVBO);
+	setStaticBuffer(GL_ARRAY_BUFFER, sizeof(glm::mat4) * std::max(maxInstances, 1), NULL, GL_DYNAMIC_STORAGE_BIT);
+	for (int c = 0; c < 4; ++c)
+	{
+		glVertexAttribPointer(1 + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4) * c));
+		glEnableVertexAttribArray(1 + c);
+		glVertexAttribDivisor(1 + c, 1);
+	}
+	glBindVertexArray(0);
 }
 
-void setSphere(unsigned int VAO_2)
+void setInstances(const std::vector<glm::mat4>& models, StaticMesh& mesh)
 {
-	glBindVertexArray(VAO_2);
-	glBindBuffer(GL_ARRAY_BUFFER, VAO_2);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * SPHERE_VEC * 3, sphereVertices, GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	mesh.numInstances = std::min((int)models.size(), mesh.maxInstances);
+	if (mesh.numInstances == 0)
+		return;
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.instanceVBO);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::mat4) * mesh.numInstances, glm::value_ptr(models[0]));
 }
 
-void renderSphere(unsigned int VAO_2)
+void renderInstances(const StaticMesh& mesh)
 {
-	setSphere(VAO_2);
-	glDrawArrays(GL_TRIANGLES, 0, SPHERE_VEC * 3);
+	if (mesh.numInstances == 0)
+		return;
+	glBindVertexArray(mesh.VAO);
+	glDrawElementsInstanced(GL_TRIANGLES, mesh.numIndices, GL_UNSIGNED_INT, 0, mesh.numInstances);
 }
 
-// Define targa header. This is only used locally.
-#pragma pack(1)
-typedef struct
-{
-	GLbyte	identsize;              // Size of ID field that follows header (0)
-	GLbyte	colorMapType;           // 0 = None, 1 = paletted
-	GLbyte	imageType;              // 0 = none, 1 = indexed, 2 = rgb, 3 = grey, +8=rle
-	unsigned short	colorMapStart;          // First colour map entry
-	unsigned short	colorMapLength;         // Number of colors
-	unsigned char 	colorMapBits;   // bits per palette entry
-	unsigned short	xstart;                 // image x origin
-	unsigned short	ystart;                 // image y origin
-	unsigned short	width;                  // width in pixels
-	unsigned short	height;                 // height in pixels
-	GLbyte	bits;                   // bits per pixel (8 16, 24, 32)
-	GLbyte	descriptor;             // image descriptor
-} TGAHEADER;
-#pragma pack(8)
-
-
-////////////////////////////////////////////////////////////////////
-// Capture the current viewport and save it as a targa file.
-// Be sure and call SwapBuffers for double buffered contexts or
-// glFinish for single buffered contexts before calling this function.
-// Returns 0 if an error occurs, or 1 on success.
-GLint gltWriteTGA(const char *szFileName)
+void deleteStaticMesh(StaticMesh& mesh)
 {
-	FILE *pFile;                // File pointer
-	TGAHEADER tgaHeader;		// TGA file header
-	unsigned long lImageSize;   // Size in bytes of image
-	GLbyte	*pBits = NULL;      // Pointer to bits
-	GLint iViewport[4];         // Viewport in pixels
-	GLenum lastBuffer;          // Storage for the current read buffer setting
-
-	// Get the viewport dimensions
-	glGetIntegerv(GL_VIEWPORT, iViewport);
-
-	// How big is the image going to be (targas are tightly packed)
-	lImageSize = iViewport[2] * 3 * iViewport[3];
-
-	// Allocate block. If this doesn't work, go home
-	pBits = (GLbyte *)malloc(lImageSize);
-	if (pBits == NULL)
-		return 0;
-
-	// Read bits from color buffer
-	glPixelStorei(GL_PACK_ALIGNMENT, 1);
-	glPixelStorei(GL_PACK_ROW_LENGTH, 0);
-	glPixelStorei(GL_PACK_SKIP_ROWS, 0);
-	glPixelStorei(GL_PACK_SKIP_PIXELS, 0);
-
-	// Get the current read buffer setting and save it. Switch to
-	// the front buffer and do the read operation. Finally, restore
-	// the read buffer state
-	glGetIntegerv(GL_READ_BUFFER, (GLint *)&lastBuffer);
-	glReadBuffer(GL_FRONT);
-	glReadPixels(0, 0, iViewport[2], iViewport[3], GL_BGR, GL_UNSIGNED_BYTE, pBits);
-	glReadBuffer(lastBuffer);
-
-	// Initialize the Targa header
-	tgaHeader.identsize = 0;
-	tgaHeader.colorMapType = 0;
-	tgaHeader.imageType = 2;
-	tgaHeader.colorMapStart = 0;
-	tgaHeader.colorMapLength = 0;
-	tgaHeader.colorMapBits = 0;
-	tgaHeader.xstart = 0;
-	tgaHeader.ystart = 0;
-	tgaHeader.width = iViewport[2];
-	tgaHeader.height = iViewport[3];
-	tgaHeader.bits = 24;
-	tgaHeader.descriptor = 0;
-
-	// Do byte swap for big vs little endian
-#ifdef __APPLE__
-	LITTLE_ENDIAN_WORD(&tgaHeader.colorMapStart);
-	LITTLE_ENDIAN_WORD(&tgaHeader.colorMapLength);
-	LITTLE_ENDIAN_WORD(&tgaHeader.xstart);
-	LITTLE_ENDIAN_WORD(&tgaHeader.ystart);
-	LITTLE_ENDIAN_WORD(&tgaHeader.width);
-	LITTLE_ENDIAN_WORD(&tgaHeader.height);
-#endif
-
-	// Attempt to open the file
-	pFile = fopen(szFileName, "wb");
-	if (pFile == NULL)
-	{
-		free(pBits);    // Free buffer and return error
-		return 0;
-	}
-
-	// Write the header
-	fwrite(&tgaHeader, sizeof(TGAHEADER), 1, pFile);
-
-	// Write the image data
-	fwrite(pBits, lImageSize, 1, pFile);
-
-	// Free temporary buffer and close the file
-	free(pBits);
-	fclose(pFile);
-
-	// Success!
-	return 1;
-}
\ No newline at end of file
+	glDeleteVertexArrays(1, &mesh.VAO);
+	glDeleteBuffers(1, &mesh.VBO);
+	glDeleteBuffers(1, &mesh.EBO);
+	glDeleteBuffers(1, &mesh.instanceVBO);
+	mesh = StaticMesh();
+}
@@ -0,0 +1,579 @@
+// Headless batch driver: steps the same scene as PBD_Cloth.cpp without any window or GL context,
+// so it can run on machines with no GPU or display.
+#include "Util.h"
+#include "Vec.h"
+#include "Cloth.h"
+#include "ClothScene.h"
+#include "MeshIO.h"
+#include "SDFCollider.h"
+#include "KinematicMeshCollider.h"
+#include "ImageWriter.h"
+#include "SoftRasterizer.h"
+#include "SphereMesh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <iostream>
+
+// simulation settings (same defaults as the interactive viewer)
+int maxFrames = 240;
+int maxSubstep = 10;
+float FPS = 24.0f;
+int solverIteration = 10;
+float dampingRate = 0.9f;
+
+// object for demoing collision
+Vec3f spherePos(0.0f, 0.0f, 0.0f);
+float sphereRadius = 5.0f;
+int numScattered = 0;  // extra small colliders around the sphere, to load the broadphase
+bool hasFloor = false;
+float floorHeight = 0.0f;
+bool continuousCollision = false;
+bool selfCollision = false;
+bool triangleSelfCollision = false;
+float selfCollisionThickness = 0.0f;  // 0: half the smaller grid spacing
+float triangleCollisionThickness = 0.0f;  // 0: half the smaller grid spacing
+float contactMargin = 0.0f;  // 0: half the larger grid spacing
+std::string meshFile;  // obj mesh collided with through a signed distance field
+float meshCellSize = 0.0f;  // 0: 1/64 of the largest mesh extent
+std::string meshCacheFile;
+std::string kinematicMeshFile;  // obj mesh swaying back and forth, streamed to its collider every frame
+float friction = 0.0f;
+
+// cloth
+int numLayers = 1;  // cloths stacked above each other, colliding with each other
+float layerGap = 0.5f;
+int resX = 51, resY = 51;
+float sizeX = 0.45f, sizeY = 0.6f;
+const float DIST_K_STIFF = 1;   // stiffness of the distance constraint
+bool hasPosConstraint = true;  // true: fix the top left and right points; false: don't fix
+int numThreads = 0;  // 0: one thread per hardware core
+Cloth::SolverType solverType = Cloth::GAUSS_SEIDEL;
+float jacobiRelaxation = 1.0f;
+KernelISA kernelISA = detectKernelISA();
+float structuralCompliance = 0.0f, shearCompliance = 0.0f;
+float xpbdWarmStart = 0.8f;
+int hierarchyLevels = 0;
+int coarseIterations = 4;
+float residualTolerance = 0.0f;
+bool chebyshev = false;
+float chebyshevRho = 0.0f;  // 0: estimate
+
+std::string outDir;  // empty: frames are dropped
+
+// software rendering of every frame, with the camera and colors of the viewer
+int renderWidth = 0, renderHeight = 0;  // 0: no rendering
+RasterMode renderMode = RASTER_WIREFRAME;
+ImageFormat imageFormat = IMAGE_TGA_RLE;
+Vec3f cameraPos(20.0f, 0.0f, -30.0f);
+float fov = 45.0f;
+Vec3f backgroundColor(0.2f, 0.3f, 0.3f);
+Vec3f meshColor(0.5f, 0.5f, 0.2f);
+
+void printUsage(const char* exeName);
+bool writeFrameObj(const ClothScene& scene, const char* fileName);
+void scatterColliders(ColliderSet& colliders, int count, const Vec3f& center, float spread);
+void animateMesh(const std::vector<Vec3f>& rest, const AABB& restBounds, float time, std::vector<Vec3f>& vertices);
+std::shared_ptr<SDFCollider> loadMeshCollider(const char* fileName, float cellSize, const char* cacheFile, ThreadPool* pool);
+
+int main(int argc, char** argv)
+{
+	// parse command line
+	// ------------------
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--frames" && i + 1 < argc)
+			maxFrames = atoi(argv[++i]);
+		else if (arg == "--substeps" && i + 1 < argc)
+			maxSubstep = atoi(argv[++i]);
+		else if (arg == "--iters" && i + 1 < argc)
+			solverIteration = atoi(argv[++i]);
+		else if (arg == "--fps" && i + 1 < argc)
+			FPS = (float)atof(argv[++i]);
+		else if (arg == "--res" && i + 2 < argc)
+		{
+			resX = atoi(argv[++i]);
+			resY = atoi(argv[++i]);
+		}
+		else if (arg == "--size" && i + 2 < argc)
+		{
+			sizeX = (float)atof(argv[++i]);
+			sizeY = (float)atof(argv[++i]);
+		}
+		else if (arg == "--threads" && i + 1 < argc)
+			numThreads = atoi(argv[++i]);
+		else if (arg == "--solver" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			if (name == "gs")
+				solverType = Cloth::GAUSS_SEIDEL;
+			else if (name == "jacobi")
+				solverType = Cloth::JACOBI;
+			else if (name == "xpbd")
+				solverType = Cloth::XPBD;
+			else if (name == "stencil")
+				solverType = Cloth::GRID_STENCIL;
+			else
+			{
+				printUsage(argv[0]);
+				return -1;
+			}
+		}
+		else if (arg == "--relax" && i + 1 < argc)
+			jacobiRelaxation = (float)atof(argv[++i]);
+		else if (arg == "--compliance" && i + 2 < argc)
+		{
+			structuralCompliance = (float)atof(argv[++i]);
+			shearCompliance = (float)atof(argv[++i]);
+		}
+		else if (arg == "--warm" && i + 1 < argc)
+			xpbdWarmStart = (float)atof(argv[++i]);
+		else if (arg == "--levels" && i + 1 < argc)
+			hierarchyLevels = atoi(argv[++i]);
+		else if (arg == "--coarse-iters" && i + 1 < argc)
+			coarseIterations = atoi(argv[++i]);
+		else if (arg == "--tol" && i + 1 < argc)
+			residualTolerance = (float)atof(argv[++i]);
+		else if (arg == "--chebyshev" && i + 1 < argc)
+		{
+			chebyshev = true;
+			chebyshevRho = (float)atof(argv[++i]);
+		}
+		else if (arg == "--isa" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			if (name == "scalar")
+				kernelISA = KERNEL_SCALAR;
+			else if (name == "avx2")
+				kernelISA = KERNEL_AVX2;
+			else if (name == "avx512")
+				kernelISA = KERNEL_AVX512;
+			else
+			{
+				printUsage(argv[0]);
+				return -1;
+			}
+		}
+		else if (arg == "--scatter" && i + 1 < argc)
+			numScattered = atoi(argv[++i]);
+		else if (arg == "--floor" && i + 1 < argc)
+		{
+			hasFloor = true;
+			floorHeight = (float)atof(argv[++i]);
+		}
+		else if (arg == "--contact-margin" && i + 1 < argc)
+			contactMargin = (float)atof(argv[++i]);
+		else if (arg == "--ccd")
+			continuousCollision = true;
+		else if (arg == "--self-collision" && i + 1 < argc)
+		{
+			selfCollision = true;
+			selfCollisionThickness = (float)atof(argv[++i]);
+		}
+		else if (arg == "--triangle-collision" && i + 1 < argc)
+		{
+			triangleSelfCollision = true;
+			triangleCollisionThickness = (float)atof(argv[++i]);
+		}
+		else if (arg == "--mesh" && i + 1 < argc)
+			meshFile = argv[++i];
+		else if (arg == "--mesh-cell" && i + 1 < argc)
+			meshCellSize = (float)atof(argv[++i]);
+		else if (arg == "--mesh-cache" && i + 1 < argc)
+			meshCacheFile = argv[++i];
+		else if (arg == "--kinematic-mesh" && i + 1 < argc)
+			kinematicMeshFile = argv[++i];
+		else if (arg == "--friction" && i + 1 < argc)
+			friction = (float)atof(argv[++i]);
+		else if (arg == "--layers" && i + 1 < argc)
+			numLayers = atoi(argv[++i]);
+		else if (arg == "--layer-gap" && i + 1 < argc)
+			layerGap = (float)atof(argv[++i]);
+		else if (arg == "--free")
+			hasPosConstraint = false;
+		else if (arg == "--out" && i + 1 < argc)
+			outDir = argv[++i];
+		else if (arg == "--render" && i + 2 < argc)
+		{
+			renderWidth = atoi(argv[++i]);
+			renderHeight = atoi(argv[++i]);
+		}
+		else if (arg == "--render-mode" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			if (name == "wire")
+				renderMode = RASTER_WIREFRAME;
+			else if (name == "flat")
+				renderMode = RASTER_FLAT;
+			else
+			{
+				printUsage(argv[0]);
+				return -1;
+			}
+		}
+		else if (arg == "--image-format" && i + 1 < argc)
+		{
+			if (!parseImageFormat(argv[++i], imageFormat))
+			{
+				printUsage(argv[0]);
+				return -1;
+			}
+		}
+		else
+		{
+			printUsage(argv[0]);
+			return arg == "--help" ? 0 : -1;
+		}
+	}
+	if (maxFrames < 1 || maxSubstep < 1 || solverIteration < 1 || resX < 2 || resY < 2 || FPS <= 0.0f || numLayers < 1 ||
+		renderWidth < 0 || renderHeight < 0 || (renderWidth > 0) != (renderHeight > 0))
+	{
+		printUsage(argv[0]);
+		return -1;
+	}
+	float timeStep = 1.0f / (FPS*maxSubstep);
+
+	// one set of threads for everything: the cloths, the contacts between them, the meshes and the renderer
+	// take turns on it, so there are never more busy threads than requested
+	std::unique_ptr<ThreadPool> pool;
+	if (numThreads != 1)
+		pool.reset(new ThreadPool(numThreads));
+
+	// the colliders are shared by all cloths
+	std::shared_ptr<ColliderSet> colliders = std::make_shared<ColliderSet>();
+	colliders->add(std::make_shared<SphereCollider>(spherePos, sphereRadius));
+	if (hasFloor)
+		colliders->add(std::make_shared<PlaneCollider>(Vec3f(0.0f, floorHeight, 0.0f), Vec3f(0.0f, 1.0f, 0.0f)));
+	scatterColliders(*colliders, numScattered, spherePos, 4 * sphereRadius);
+	if (!meshFile.empty())
+	{
+		std::shared_ptr<SDFCollider> meshCollider = loadMeshCollider(meshFile.c_str(), meshCellSize, meshCacheFile.c_str(), pool.get());
+		if (!meshCollider)
+			return -1;
+		colliders->add(meshCollider);
+	}
+
+	// the animated mesh: its collider gets the vertices of every frame from animateMesh()
+	std::vector<Vec3f> restVertices, meshVertices;
+	std::vector<Vec3i> meshTriangles;
+	AABB restBounds;
+	std::shared_ptr<KinematicMeshCollider> kinematicMesh;
+	if (!kinematicMeshFile.empty())
+	{
+		if (!loadObj(kinematicMeshFile.c_str(), restVertices, meshTriangles) || meshTriangles.empty())
+		{
+			printf("reading mesh %s failed!\n", kinematicMeshFile.c_str());
+			return -1;
+		}
+		for (size_t v = 0; v < restVertices.size(); ++v)
+			restBounds.expand(restVertices[v]);
+		kinematicMesh = std::make_shared<KinematicMeshCollider>(restVertices, meshTriangles);
+		colliders->add(kinematicMesh);
+		printf("kinematic mesh %s: %d vertices, %d triangles\n", kinematicMeshFile.c_str(), (int)restVertices.size(), (int)meshTriangles.size());
+	}
+
+	// create cloth objs, each layer above the previous one
+	ClothScene scene(pool.get());
+	for (int layer = 0; layer < numLayers; ++layer)
+	{
+		Vec3f clothPos(-10.0f, 10.0f + layer * layerGap, -20.0f);  // tranlate to the center
+		std::shared_ptr<Cloth> cloth = std::make_shared<Cloth>(resX, resY, sizeX, sizeY, DIST_K_STIFF, hasPosConstraint, clothPos, 1);
+		cloth->solverType = solverType;
+		cloth->jacobiRelaxation = jacobiRelaxation;
+		cloth->setKernelISA(kernelISA);
+		cloth->setCompliance(structuralCompliance, shearCompliance);
+		cloth->xpbdWarmStart = xpbdWarmStart;
+		cloth->setHierarchyLevels(hierarchyLevels);
+		cloth->coarseIterations = coarseIterations;
+		cloth->residualTolerance = residualTolerance;
+		cloth->chebyshev = chebyshev;
+		cloth->chebyshevRho = chebyshevRho;
+		cloth->continuousCollision = continuousCollision;
+		cloth->selfCollision = selfCollision;
+		cloth->triangleSelfCollision = triangleSelfCollision;
+		cloth->selfCollisionThickness = selfCollisionThickness;
+		cloth->triangleCollisionThickness = triangleCollisionThickness;
+		cloth->contactMargin = contactMargin;
+		cloth->friction = friction;
+		cloth->colliders = colliders;
+		scene.add(cloth);
+	}
+	Cloth& newCloth = scene[0];
+	if (numLayers > 1)
+		printf("%d cloth layers %.2f apart\n", numLayers, layerGap);
+	printf("cloth %dx%d: %d points, %d distance constraints in %d colors; %d frames x %d substeps, %d solver iterations, %d threads\n",
+		resX, resY, newCloth.points.size(), (int)newCloth.distConstraintList.size(), (int)newCloth.constraintColorOffsets.size() - 1,
+		maxFrames, maxSubstep, solverIteration, newCloth.threadCount());
+	const char* solverNames[] = { "gauss-seidel", "jacobi", "xpbd", "grid stencil" };
+	printf("%s solver, %s constraint kernel, %d coarse levels x %d iterations, %d colliders\n", solverNames[solverType], kernelISAName(newCloth.kernelISA()),
+		newCloth.hierarchyLevels(), coarseIterations, newCloth.colliders->size());
+
+	// software renderer looking at the scene like the viewer does
+	std::unique_ptr<SoftRasterizer> renderer;
+	std::vector<Vec3f> sphereVertices;
+	std::vector<unsigned int> sphereIndices, meshIndices;
+	std::vector<Mat4> sphereModels;  // one per sphere collider, like the viewer's instances
+	std::vector<unsigned char> imageBuffer;
+	if (renderWidth > 0)
+	{
+		renderer.reset(new SoftRasterizer(renderWidth, renderHeight, pool.get()));
+		renderer->setCamera(Mat4::lookAt(cameraPos, Vec3f(0.0f), Vec3f(0.0f, 1.0f, 0.0f)),
+			Mat4::perspective(fov * (float)M_PI / 180, (float)renderWidth / renderHeight, 0.1f, 100.0f));
+		sphereMesh(sphereVertices, sphereIndices);
+		for (int c = 0; c < colliders->size(); ++c)
+		{
+			const SphereCollider* sphere = dynamic_cast<const SphereCollider*>(&(*colliders)[c]);
+			if (sphere)
+				sphereModels.push_back(Mat4::translation(sphere->center) * Mat4::scaling(Vec3f(sphere->radius)));
+		}
+		for (size_t t = 0; t < meshTriangles.size(); ++t)
+			for (int k = 0; k < 3; ++k)
+				meshIndices.push_back(meshTriangles[t][k]);
+	}
+
+	// simulation loop
+	// ---------------
+	typedef std::chrono::steady_clock Clock;
+	double totalMs = 0.0, minMs = 1e30, maxMs = 0.0;
+	double refitMs = 0.0, interpolateMs = 0.0;  // of the kinematic mesh, included in the frame times
+	double rasterMs = 0.0, imageMs = 0.0;  // software rendering and writing the images, not included
+	long long totalIterations = 0;
+	for (int frameNum = 1; frameNum <= maxFrames; ++frameNum)
+	{
+		Clock::time_point frameStart = Clock::now();
+		int frameIterations = 0;
+		if (kinematicMesh)
+		{
+			animateMesh(restVertices, restBounds, frameNum / FPS, meshVertices);
+			Clock::time_point start = Clock::now();
+			kinematicMesh->setFrame(meshVertices, 1 / FPS, pool.get());
+			colliders->build();  // the mesh bounds moved
+			refitMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		}
+		for (int substep = 1; substep <= maxSubstep; ++substep)
+		{
+			if (kinematicMesh)
+			{
+				Clock::time_point start = Clock::now();
+				kinematicMesh->setTime((float)substep / maxSubstep, pool.get());
+				interpolateMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			}
+			scene.update(timeStep, dampingRate, hasPosConstraint, solverIteration);
+			frameIterations += newCloth.lastIterationCount();
+		}
+		double frameMs = std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count();
+		totalIterations += frameIterations;
+
+		totalMs += frameMs;
+		minMs = min(minMs, frameMs);
+		maxMs = max(maxMs, frameMs);
+		printf("frame %d: %.3f ms, %.1f iterations/substep, residual %.2e", frameNum, frameMs, (float)frameIterations / maxSubstep, newCloth.lastResidual());
+		if (numLayers > 1)
+			printf(", %d cloth contacts", scene.lastContactCount());
+		printf("\n");
+
+		// save each frame as an obj file (not included in the timing)
+		if (!outDir.empty())
+		{
+			std::string fileName = outDir + "/" + std::to_string(frameNum) + "_frame.obj";
+			if (!writeFrameObj(scene, fileName.c_str()))
+			{
+				printf("saving %s failed!\n", fileName.c_str());
+				return -1;
+			}
+		}
+
+		// render the frame in software and save the image (not included in the timing either)
+		if (renderer)
+		{
+			Clock::time_point start = Clock::now();
+			renderer->clear(backgroundColor);
+			for (int c = 0; c < scene.size(); ++c)
+			{
+				const Cloth& cloth = scene[c];
+				renderer->draw(cloth.points.pos.data(), cloth.points.size(), cloth.indexArray.data(), (int)cloth.indexArray.size(),
+					Mat4(), meshColor, renderMode);
+			}
+			for (size_t s = 0; s < sphereModels.size(); ++s)
+				renderer->draw(sphereVertices.data(), (int)sphereVertices.size(), sphereIndices.data(), (int)sphereIndices.size(),
+					sphereModels[s], meshColor, renderMode);
+			if (kinematicMesh)
+				renderer->draw(kinematicMesh->vertices().data(), (int)kinematicMesh->vertices().size(), meshIndices.data(),
+					(int)meshIndices.size(), Mat4(), meshColor, renderMode);
+			renderer->render();
+			Clock::time_point rendered = Clock::now();
+			rasterMs += std::chrono::duration<double, std::milli>(rendered - start).count();
+
+			std::string fileName = frameFileName(outDir, frameNum, 4, imageFormat);
+			if (!writeImage(fileName, renderer->pixels().data(), renderWidth, renderHeight, imageFormat, imageBuffer, pool.get()))
+			{
+				printf("saving %s failed!\n", fileName.c_str());
+				return -1;
+			}
+			imageMs += std::chrono::duration<double, std::milli>(Clock::now() - rendered).count();
+		}
+	}
+	printf("total %.3f ms, avg %.3f ms/frame, min %.3f ms, max %.3f ms, avg %.2f iterations/substep\n", totalMs, totalMs / maxFrames, minMs, maxMs,
+		(double)totalIterations / ((double)maxFrames * maxSubstep));
+	if (kinematicMesh)
+		printf("kinematic mesh: refit %.3f ms/frame (%d rebuilds), interpolation %.3f ms/substep\n", refitMs / maxFrames, kinematicMesh->buildCount() - 1,
+			interpolateMs / ((double)maxFrames * maxSubstep));
+	if (renderer)
+		printf("render %dx%d %s: raster %.3f ms/frame, %s encode and write %.3f ms/frame\n", renderWidth, renderHeight,
+			renderMode == RASTER_FLAT ? "flat" : "wireframe", rasterMs / maxFrames, imageFormatName(imageFormat), imageMs / maxFrames);
+	return 0;
+}
+
+void printUsage(const char* exeName)
+{
+	printf("usage: %s [options]\n", exeName);
+	printf("  --frames N        number of frames to simulate (default %d)\n", maxFrames);
+	printf("  --substeps N      substeps per frame (default %d)\n", maxSubstep);
+	printf("  --iters N         solver iterations per substep (default %d)\n", solverIteration);
+	printf("  --fps F           frames per second (default %.1f)\n", FPS);
+	printf("  --res X Y         # of points on each width and height (default %d %d)\n", resX, resY);
+	printf("  --size X Y        length between each two points (default %.2f %.2f)\n", sizeX, sizeY);
+	printf("  --threads N       threads shared by the solver, meshes and renderer, 1: serial (default: one per hardware core)\n");
+	printf("  --solver gs|jacobi|xpbd|stencil  constraint projection: colored Gauss-Seidel, Jacobi, compliant XPBD\n");
+	printf("                    or Gauss-Seidel on the implicit grid stencil (default gs)\n");
+	printf("  --relax W         Jacobi relaxation factor applied to the averaged deltas (default %.2f)\n", jacobiRelaxation);
+	printf("  --compliance S H  XPBD compliance of structural and shear constraints (default %g %g)\n", structuralCompliance, shearCompliance);
+	printf("  --warm W          XPBD fraction of the multipliers carried over between substeps (default %.2f);\n", xpbdWarmStart);
+	printf("                    needs --compliance above 0, inextensible constraints are never warm started\n");
+	printf("  --levels N        coarse grid levels solved before the fine iterations (default %d)\n", hierarchyLevels);
+	printf("  --coarse-iters N  iterations per coarse level (default %d)\n", coarseIterations);
+	printf("  --tol T           stop iterating once the largest relative stretch is below T; --iters is the maximum (default off)\n");
+	printf("  --chebyshev RHO   Chebyshev acceleration with spectral radius RHO; 0 estimates it (default off)\n");
+	printf("  --isa scalar|avx2|avx512  Gauss-Seidel batch kernel (default: best supported, %s)\n", kernelISAName(kernelISA));
+	printf("  --scatter N       add N small spheres, capsules and boxes around the sphere (default %d)\n", numScattered);
+	printf("  --floor Y         add a ground plane at height Y\n");
+	printf("  --contact-margin M  colliders within M of a predicted point become its contacts for the substep;\n");
+	printf("                    0: half the larger grid spacing (default 0)\n");
+	printf("  --ccd             sweep each substep's moves against the colliders so fast points cannot tunnel\n");
+	printf("  --self-collision T  keep unconnected points T apart; 0: half the smaller grid spacing (default off)\n");
+	printf("  --triangle-collision T  vertex-triangle and edge-edge self-collision with thickness T; 0: half the smaller\n");
+	printf("                    grid spacing (default off)\n");
+	printf("  --mesh FILE       collide with the closed triangle mesh of an obj file\n");
+	printf("  --mesh-cell H     distance field spacing of the mesh (default: 1/64 of its largest extent)\n");
+	printf("  --mesh-cache FILE load the mesh distance field from FILE if it matches, otherwise build and save it there\n");
+	printf("  --kinematic-mesh FILE  collide with the triangle mesh of an obj file that sways back and forth, streamed\n");
+	printf("                    to the collider every frame (closed, counterclockwise seen from outside)\n");
+	printf("  --friction MU     friction of the points on the colliders (default %g)\n", friction);
+	printf("  --layers N        stack N cloths above each other that collide with each other (default %d)\n", numLayers);
+	printf("  --layer-gap D     vertical distance between the layers (default %.2f)\n", layerGap);
+	printf("  --free            do not fix the top left and right points\n");
+	printf("  --out DIR         write every frame to DIR/N_frame.obj; frames are dropped otherwise\n");
+	printf("  --render W H      draw every frame in software at W x H pixels, as the viewer shows it, and save it as\n");
+	printf("                    DIR/NNNN_frame.tga (or .qoi); DIR from --out, else the working directory\n");
+	printf("  --render-mode wire|flat  triangle edges like the viewer or flat shaded triangles (default wire)\n");
+	printf("  --image-format tga|rle|qoi  rendered images as plain or run length encoded targa, or QOI (default %s)\n",
+		imageFormatName(imageFormat));
+}
+
+// Save the current positions and triangles of all cloths as one wavefront obj file.
+// Returns false if the file could not be written.
+bool writeFrameObj(const ClothScene& scene, const char* fileName)
+{
+	FILE* pFile = fopen(fileName, "w");
+	if (pFile == NULL)
+		return false;
+
+	for (int c = 0; c < scene.size(); ++c)
+	{
+		const Cloth& cloth = scene[c];
+		for (int i = 0; i < cloth.points.size(); ++i)
+		{
+			const Vec3f& p = cloth.points.pos[i];
+			fprintf(pFile, "v %f %f %f\n", p[0], p[1], p[2]);
+		}
+	}
+	// obj indices are 1-based and count the vertices of all cloths before
+	unsigned int first = 1;
+	for (int c = 0; c < scene.size(); ++c)
+	{
+		const Cloth& cloth = scene[c];
+		for (size_t i = 0; i + 2 < cloth.indexArray.size(); i += 3)
+			fprintf(pFile, "f %u %u %u\n", cloth.indexArray[i] + first, cloth.indexArray[i + 1] + first, cloth.indexArray[i + 2] + first);
+		first += cloth.points.size();
+	}
+
+	bool ok = !ferror(pFile);
+	fclose(pFile);
+	return ok;
+}
+
+// Scatter count small colliders of mixed types in a cube of edge spread around center.
+// The positions are repeatable, so runs with the same count can be compared.
+void scatterColliders(ColliderSet& colliders, int count, const Vec3f& center, float spread)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		unsigned int seed = 4 * i;
+		Vec3f p = center + Vec3f(randhashf(seed, -0.5f, 0.5f), randhashf(seed + 1, -0.5f, 0.5f), randhashf(seed + 2, -0.5f, 0.5f)) * spread;
+		float size = randhashf(seed + 3, 0.2f, 1.0f);
+		if (i % 3 == 0)
+			colliders.add(std::make_shared<SphereCollider>(p, size));
+		else if (i % 3 == 1)
+			colliders.add(std::make_shared<CapsuleCollider>(p - Vec3f(size, 0.0f, 0.0f), p + Vec3f(size, 0.0f, 0.0f), 0.5f * size));
+		else
+			colliders.add(std::make_shared<BoxCollider>(p, Vec3f(size)));
+	}
+}
+
+// Read an obj mesh and build its distance field, or load the field from cacheFile if it was built for the same mesh.
+// Returns NULL if the mesh could not be read.
+std::shared_ptr<SDFCollider> loadMeshCollider(const char* fileName, float cellSize, const char* cacheFile, ThreadPool* pool)
+{
+	std::vector<Vec3f> vertices;
+	std::vector<Vec3i> triangles;
+	if (!loadObj(fileName, vertices, triangles) || triangles.empty())
+	{
+		printf("reading mesh %s failed!\n", fileName);
+		return std::shared_ptr<SDFCollider>();
+	}
+	if (cellSize <= 0.0f)
+	{
+		AABB box;
+		for (size_t v = 0; v < vertices.size(); ++v)
+			box.expand(vertices[v]);
+		cellSize = max(box.hi - box.lo) / 64;
+	}
+	float bandWidth = 3 * cellSize;
+
+	std::shared_ptr<SDFCollider> collider = std::make_shared<SDFCollider>();
+	unsigned long long hash = SDFCollider::meshHash(vertices, triangles, cellSize, bandWidth);
+	if (cacheFile[0] != '\0' && collider->load(cacheFile, hash))
+	{
+		printf("mesh %s: distance field loaded from %s\n", fileName, cacheFile);
+		return collider;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	collider = std::make_shared<SDFCollider>(vertices, triangles, cellSize, bandWidth, pool);
+	printf("mesh %s: %d triangles, distance field with %d blocks built in %.3f ms\n", fileName, (int)triangles.size(), collider->blockCount(),
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	if (cacheFile[0] != '\0' && !collider->save(cacheFile))
+		printf("saving %s failed!\n", cacheFile);
+	return collider;
+}
+
+// The frame of a made up animation of the mesh: it bends back and forth around the bottom of its bounds,
+// the more the higher up a vertex is, like a swaying tree or a waving arm.
+void animateMesh(const std::vector<Vec3f>& rest, const AABB& restBounds, float time, std::vector<Vec3f>& vertices)
+{
+	Vec3f pivot((restBounds.lo[0] + restBounds.hi[0]) * 0.5f, restBounds.lo[1], (restBounds.lo[2] + restBounds.hi[2]) * 0.5f);
+	float height = max(restBounds.hi[1] - restBounds.lo[1], M_EPSION);
+	float sway = 0.6f * (float)sin(M_PI * time);  // bend at the top in radians, back and forth every two seconds
+	vertices.resize(rest.size());
+	for (size_t v = 0; v < rest.size(); ++v)
+	{
+		Vec3f local = rest[v] - pivot;
+		float angle = sway * local[1] / height;
+		float c = cos(angle), s = sin(angle);
+		vertices[v] = pivot + Vec3f(c * local[0] - s * local[1], s * local[0] + c * local[1], local[2]);
+	}
+}
@@ -0,0 +1,500 @@
+#include "SDFCollider.h"
+#include "Geometry.h"
+
+#include <cstdio>
+#include <cstring>
+
+static const char SDF_FILE_MAGIC[8] = { 'P', 'B', 'D', 'S', 'D', 'F', '0', '2' };
+
+// header of a cached field; followed by the block index, the block center distances and the distances of
+// the allocated blocks
+struct SDFFileHeader
+{
+	char magic[8];
+	unsigned long long hash;
+	float cellSize, bandWidth;
+	float origin[3];
+	float boundsLo[3], boundsHi[3];
+	int dims[3];
+	int numAllocated;
+};
+
+template<class F>
+static void runParallel(ThreadPool* pool, int begin, int end, int grainSize, const F& func)
+{
+	if (pool)
+		pool->parallelFor(begin, end, grainSize, func);
+	else
+		func(begin, end);
+}
+
+// 64 bit FNV-1a
+static void hashBytes(unsigned long long& hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+}
+
+unsigned long long SDFCollider::meshHash(const std::vector<Vec3f>& vertices, const std::vector<Vec3i>& triangles, float cellSize, float bandWidth)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	if (!vertices.empty())
+		hashBytes(hash, &vertices[0], vertices.size() * sizeof(Vec3f));
+	if (!triangles.empty())
+		hashBytes(hash, &triangles[0], triangles.size() * sizeof(Vec3i));
+	hashBytes(hash, &cellSize, sizeof(cellSize));
+	hashBytes(hash, &bandWidth, sizeof(bandWidth));
+	return hash;
+}
+
+SDFCollider::SDFCollider(const std::vector<Vec3f>& vertices, const std::vector<Vec3i>& triangles, float cellSize, float bandWidth,
+	ThreadPool* pool)
+	: _cellSize(cellSize), _bandWidth(bandWidth)
+{
+	_hash = meshHash(vertices, triangles, cellSize, bandWidth);
+	for (size_t v = 0; v < vertices.size(); ++v)
+		_meshBounds.expand(vertices[v]);
+	if (_meshBounds.empty())
+		return;
+
+	// nodes cover the mesh plus the band on every side
+	float pad = bandWidth + cellSize;
+	_origin = _meshBounds.lo - Vec3f(pad);
+	int numBlocks = 1;
+	for (int k = 0; k < 3; ++k)
+	{
+		_dims[k] = (int)std::ceil((_meshBounds.hi[k] - _meshBounds.lo[k] + 2 * pad) / cellSize) + 1;
+		_blockDims[k] = (_dims[k] + BLOCK - 1) / BLOCK;
+		numBlocks *= _blockDims[k];
+	}
+	float invCellSize = 1 / cellSize;
+	int numTriangles = (int)triangles.size();
+
+	// 1. bin every triangle into the blocks within bandWidth of it (counting sort)
+	// -----------------------------
+	std::vector<int> blockTriOffsets(numBlocks + 1, 0);
+	std::vector<int> blockTris;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		std::vector<int> slot;
+		if (pass == 1)
+		{
+			for (int b = 0; b < numBlocks; ++b)
+				blockTriOffsets[b + 1] += blockTriOffsets[b];
+			blockTris.resize(blockTriOffsets[numBlocks]);
+			slot.assign(blockTriOffsets.begin(), blockTriOffsets.end() - 1);
+		}
+		for (int t = 0; t < numTriangles; ++t)
+		{
+			AABB box;
+			for (int v = 0; v < 3; ++v)
+				box.expand(vertices[triangles[t][v]]);
+			box.inflate(bandWidth);
+			int lo[3], hi[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				lo[k] = clamp((int)std::ceil((box.lo[k] - _origin[k]) * invCellSize), 0, _dims[k] - 1) / BLOCK;
+				hi[k] = clamp((int)std::floor((box.hi[k] - _origin[k]) * invCellSize), 0, _dims[k] - 1) / BLOCK;
+			}
+			for (int bz = lo[2]; bz <= hi[2]; ++bz)
+				for (int by = lo[1]; by <= hi[1]; ++by)
+					for (int bx = lo[0]; bx <= hi[0]; ++bx)
+					{
+						int b = (bz * _blockDims[1] + by) * _blockDims[0] + bx;
+						if (pass == 0)
+							blockTriOffsets[b + 1]++;
+						else
+							blockTris[slot[b]++] = t;
+					}
+		}
+	}
+	_blockIndex.assign(numBlocks, FAR_OUTSIDE);
+	std::vector<int> allocated;
+	for (int b = 0; b < numBlocks; ++b)
+	{
+		if (blockTriOffsets[b + 1] > blockTriOffsets[b])
+		{
+			_blockIndex[b] = (int)allocated.size();
+			allocated.push_back(b);
+		}
+	}
+	_blockData.assign(allocated.size() * BLOCK_NODES, bandWidth);
+
+	// 2. unsigned distance of the nodes of each allocated block to its triangles
+	// -----------------------------
+	runParallel(pool, 0, (int)allocated.size(), 1, [&](int begin, int end)
+	{
+		for (int s = begin; s < end; ++s)
+		{
+			int b = allocated[s];
+			int bx = b % _blockDims[0], by = (b / _blockDims[0]) % _blockDims[1], bz = b / (_blockDims[0] * _blockDims[1]);
+			float* data = &_blockData[s * BLOCK_NODES];
+			for (int n = 0; n < BLOCK_NODES; ++n)
+			{
+				int i = bx * BLOCK + n % BLOCK, j = by * BLOCK + (n / BLOCK) % BLOCK, k = bz * BLOCK + n / (BLOCK * BLOCK);
+				if (i >= _dims[0] || j >= _dims[1] || k >= _dims[2])
+					continue;
+				Vec3f p = _origin + Vec3f((float)i, (float)j, (float)k) * cellSize;
+				float minDist2 = sqr(bandWidth);
+				for (int e = blockTriOffsets[b]; e < blockTriOffsets[b + 1]; ++e)
+				{
+					const Vec3i& tri = triangles[blockTris[e]];
+					minDist2 = min(minDist2, dist2(p, closestPointOnTriangle(p, vertices[tri[0]], vertices[tri[1]], vertices[tri[2]])));
+				}
+				data[n] = sqrt(minDist2);
+			}
+		}
+	});
+
+	// 3. signs from the parity of the crossings of a ray along +x through each row of nodes
+	// -----------------------------
+	// the triangles each row of nodes (j, k) may cross, binned by their yz bounds
+	int numRows = _dims[1] * _dims[2];
+	std::vector<int> rowTriOffsets(numRows + 1, 0);
+	std::vector<int> rowTris;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		std::vector<int> slot;
+		if (pass == 1)
+		{
+			for (int r = 0; r < numRows; ++r)
+				rowTriOffsets[r + 1] += rowTriOffsets[r];
+			rowTris.resize(rowTriOffsets[numRows]);
+			slot.assign(rowTriOffsets.begin(), rowTriOffsets.end() - 1);
+		}
+		for (int t = 0; t < numTriangles; ++t)
+		{
+			AABB box;
+			for (int v = 0; v < 3; ++v)
+				box.expand(vertices[triangles[t][v]]);
+			int jLo = max((int)std::ceil((box.lo[1] - _origin[1]) * invCellSize) - 1, 0);
+			int jHi = min((int)std::floor((box.hi[1] - _origin[1]) * invCellSize) + 1, _dims[1] - 1);
+			int kLo = max((int)std::ceil((box.lo[2] - _origin[2]) * invCellSize) - 1, 0);
+			int kHi = min((int)std::floor((box.hi[2] - _origin[2]) * invCellSize) + 1, _dims[2] - 1);
+			for (int k = kLo; k <= kHi; ++k)
+				for (int j = jLo; j <= jHi; ++j)
+				{
+					if (pass == 0)
+						rowTriOffsets[k * _dims[1] + j + 1]++;
+					else
+						rowTris[slot[k * _dims[1] + j]++] = t;
+				}
+		}
+	}
+
+	// every row writes its own nodes; blocks without storage take the sign of their first node
+	std::vector<char> farInside(numBlocks, 0);
+	runParallel(pool, 0, numRows, 16, [&](int begin, int end)
+	{
+		std::vector<float> crossings;
+		for (int r = begin; r < end; ++r)
+		{
+			int j = r % _dims[1], k = r / _dims[1];
+			// nudge the ray off the node so it does not hit mesh edges through grid aligned vertices
+			float y = _origin[1] + (j + 1.37e-3f) * cellSize;
+			float z = _origin[2] + (k + 2.71e-3f) * cellSize;
+			crossings.clear();
+			for (int e = rowTriOffsets[r]; e < rowTriOffsets[r + 1]; ++e)
+			{
+				const Vec3i& tri = triangles[rowTris[e]];
+				float x;
+				if (crossTriangleX(y, z, vertices[tri[0]], vertices[tri[1]], vertices[tri[2]], x))
+					crossings.push_back(x);
+			}
+			std::sort(crossings.begin(), crossings.end());
+
+			// walking along +x, the node is inside if an odd number of crossings lies ahead of it
+			size_t passed = 0;
+			int by = j / BLOCK, bz = k / BLOCK;
+			for (int i = 0; i < _dims[0]; ++i)
+			{
+				float x = _origin[0] + i * cellSize;
+				while (passed < crossings.size() && crossings[passed] <= x)
+					++passed;
+				bool inside = (crossings.size() - passed) % 2 == 1;
+				int b = (bz * _blockDims[1] + by) * _blockDims[0] + i / BLOCK;
+				int s = _blockIndex[b];
+				if (s >= 0)
+				{
+					if (inside)
+					{
+						float& d = _blockData[s * BLOCK_NODES + ((k % BLOCK) * BLOCK + j % BLOCK) * BLOCK + i % BLOCK];
+						d = -d;
+					}
+				}
+				else if (i % BLOCK == 0 && j % BLOCK == 0 && k % BLOCK == 0)
+					farInside[b] = inside;
+			}
+		}
+	});
+	for (int b = 0; b < numBlocks; ++b)
+	{
+		if (farInside[b])
+			_blockIndex[b] = FAR_INSIDE;
+	}
+
+	// 4. coarse distances of the blocks, for the way out of the flat interior
+	// -----------------------------
+	computeBlockDistances();
+}
+
+void SDFCollider::computeBlockDistances()
+{
+	int numBlocks = (int)_blockIndex.size();
+	_blockDistance.assign(numBlocks, _bandWidth);
+	for (int b = 0; b < numBlocks; ++b)
+	{
+		int bx = b % _blockDims[0], by = (b / _blockDims[0]) % _blockDims[1], bz = b / (_blockDims[0] * _blockDims[1]);
+		if (_blockIndex[b] >= 0)
+			_blockDistance[b] = node(min(bx * BLOCK + BLOCK / 2, _dims[0] - 1), min(by * BLOCK + BLOCK / 2, _dims[1] - 1),
+				min(bz * BLOCK + BLOCK / 2, _dims[2] - 1));
+		else if (_blockIndex[b] == FAR_INSIDE)
+			_blockDistance[b] = -1e30f;
+	}
+
+	// chamfer distance over the 26 neighbors from the allocated blocks inward, sweeping forward and backward
+	// until it settles. The outside never borders the inside directly (a band block lies between), so it is
+	// skipped, and the descent leads to the closest band whatever the shape of the mesh
+	float blockSize = BLOCK * _cellSize;
+	bool changed = true;
+	for (int pass = 0; changed; ++pass)
+	{
+		changed = false;
+		for (int n = 0; n < numBlocks; ++n)
+		{
+			int b = pass % 2 == 0 ? n : numBlocks - 1 - n;
+			if (_blockIndex[b] != FAR_INSIDE)
+				continue;
+			int bx = b % _blockDims[0], by = (b / _blockDims[0]) % _blockDims[1], bz = b / (_blockDims[0] * _blockDims[1]);
+			float deepest = -_bandWidth;  // every block here is deeper than the band, however close its neighbors are
+			float dist = _blockDistance[b];
+			for (int dz = -1; dz <= 1; ++dz)
+				for (int dy = -1; dy <= 1; ++dy)
+					for (int dx = -1; dx <= 1; ++dx)
+					{
+						int x = bx + dx, y = by + dy, z = bz + dz;
+						if (x < 0 || y < 0 || z < 0 || x >= _blockDims[0] || y >= _blockDims[1] || z >= _blockDims[2])
+							continue;
+						int nb = (z * _blockDims[1] + y) * _blockDims[0] + x;
+						if (_blockIndex[nb] == FAR_OUTSIDE)
+							continue;
+						dist = max(dist, min(_blockDistance[nb] - blockSize * std::sqrt((float)(dx * dx + dy * dy + dz * dz)), deepest));
+					}
+			if (dist > _blockDistance[b])
+			{
+				_blockDistance[b] = dist;
+				changed = true;
+			}
+		}
+	}
+}
+
+float SDFCollider::node(int i, int j, int k) const
+{
+	int s = _blockIndex[((k / BLOCK) * _blockDims[1] + j / BLOCK) * _blockDims[0] + i / BLOCK];
+	if (s < 0)
+		return s == FAR_INSIDE ? -_bandWidth : _bandWidth;
+	return _blockData[s * BLOCK_NODES + ((k % BLOCK) * BLOCK + j % BLOCK) * BLOCK + i % BLOCK];
+}
+
+bool SDFCollider::locate(const Vec3f& p, int cell[3], Vec3f& frac) const
+{
+	for (int k = 0; k < 3; ++k)
+	{
+		float g = (p[k] - _origin[k]) / _cellSize;
+		if (!(g >= 0.0f && g <= _dims[k] - 1))  // also rejects nan
+			return false;
+		cell[k] = min((int)g, _dims[k] - 2);
+		frac[k] = g - cell[k];
+	}
+	return true;
+}
+
+float SDFCollider::sample(const Vec3f& p) const
+{
+	Vec3f normal;
+	return signedDistance(p, normal);
+}
+
+Vec3f SDFCollider::gradient(const Vec3f& p) const
+{
+	int c[3];
+	Vec3f f;
+	if (!locate(p, c, f))
+		return Vec3f(0.0f);
+	float v[8];
+	for (int n = 0; n < 8; ++n)
+		v[n] = node(c[0] + (n & 1), c[1] + ((n >> 1) & 1), c[2] + (n >> 2));
+	// derivatives of the trilinear interpolant along each axis
+	float invCellSize = 1 / _cellSize;
+	return Vec3f(
+		bilerp(v[1] - v[0], v[3] - v[2], v[5] - v[4], v[7] - v[6], f[1], f[2]) * invCellSize,
+		bilerp(v[2] - v[0], v[3] - v[1], v[6] - v[4], v[7] - v[5], f[0], f[2]) * invCellSize,
+		bilerp(v[4] - v[0], v[5] - v[1], v[6] - v[2], v[7] - v[3], f[0], f[1]) * invCellSize);
+}
+
+float SDFCollider::signedDistance(const Vec3f& p, Vec3f& normal) const
+{
+	int c[3];
+	Vec3f f;
+	if (!locate(p, c, f))
+	{
+		normal = Vec3f(0.0f);
+		return _bandWidth;  // beyond the band around the mesh
+	}
+	float v[8];
+	for (int n = 0; n < 8; ++n)
+		v[n] = node(c[0] + (n & 1), c[1] + ((n >> 1) & 1), c[2] + (n >> 2));
+	float dist = trilerp(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], f[0], f[1], f[2]);
+	normal = gradient(p);
+	float len = mag(normal);
+	if (len > M_EPSION)
+		normal /= len;
+	else if (dist < 0.0f)
+	{
+		// flat inside: deeper than the band, or at a maximum of the depth
+		normal = coarseGradient(p);
+		len = mag(normal);
+		normal = len > M_EPSION ? normal / len : shallowestNeighbor(p);
+	}
+	else
+		normal = Vec3f(0.0f);
+	return dist;
+}
+
+Vec3f SDFCollider::coarseGradient(const Vec3f& p) const
+{
+	// block b's center is at coarse coordinate b; beyond the outer centers the field is extended flat
+	int c[3];
+	Vec3f f;
+	for (int k = 0; k < 3; ++k)
+	{
+		if (_blockDims[k] < 2)
+			return Vec3f(0.0f);
+		float g = clamp((p[k] - _origin[k]) / (BLOCK * _cellSize) - 0.5f, 0.0f, (float)(_blockDims[k] - 1));
+		c[k] = min((int)g, _blockDims[k] - 2);
+		f[k] = g - c[k];
+	}
+	float v[8];
+	for (int n = 0; n < 8; ++n)
+		v[n] = _blockDistance[((c[2] + (n >> 2)) * _blockDims[1] + c[1] + ((n >> 1) & 1)) * _blockDims[0] + c[0] + (n & 1)];
+	return Vec3f(
+		bilerp(v[1] - v[0], v[3] - v[2], v[5] - v[4], v[7] - v[6], f[1], f[2]),
+		bilerp(v[2] - v[0], v[3] - v[1], v[6] - v[4], v[7] - v[5], f[0], f[2]),
+		bilerp(v[4] - v[0], v[5] - v[1], v[6] - v[2], v[7] - v[3], f[0], f[1])) / (BLOCK * _cellSize);
+}
+
+Vec3f SDFCollider::shallowestNeighbor(const Vec3f& p) const
+{
+	int c[3];
+	for (int k = 0; k < 3; ++k)
+		c[k] = clamp((int)((p[k] - _origin[k]) / (BLOCK * _cellSize)), 0, _blockDims[k] - 1);
+	float best = _blockDistance[(c[2] * _blockDims[1] + c[1]) * _blockDims[0] + c[0]];
+	Vec3f normal(0.0f);
+	for (int dz = -1; dz <= 1; ++dz)
+		for (int dy = -1; dy <= 1; ++dy)
+			for (int dx = -1; dx <= 1; ++dx)
+			{
+				int x = c[0] + dx, y = c[1] + dy, z = c[2] + dz;
+				if (x < 0 || y < 0 || z < 0 || x >= _blockDims[0] || y >= _blockDims[1] || z >= _blockDims[2])
+					continue;
+				float d = _blockDistance[(z * _blockDims[1] + y) * _blockDims[0] + x];
+				if (d > best)
+				{
+					best = d;
+					normal = Vec3f((float)dx, (float)dy, (float)dz);
+				}
+			}
+	float len = mag(normal);
+	return len > 0.0f ? normal / len : normal;
+}
+
+bool SDFCollider::save(const char* fileName) const
+{
+	FILE* pFile = fopen(fileName, "wb");
+	if (pFile == NULL)
+		return false;
+
+	SDFFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SDF_FILE_MAGIC, sizeof(header.magic));
+	header.hash = _hash;
+	header.cellSize = _cellSize;
+	header.bandWidth = _bandWidth;
+	for (int k = 0; k < 3; ++k)
+	{
+		header.origin[k] = _origin[k];
+		header.boundsLo[k] = _meshBounds.lo[k];
+		header.boundsHi[k] = _meshBounds.hi[k];
+		header.dims[k] = _dims[k];
+	}
+	header.numAllocated = blockCount();
+	fwrite(&header, sizeof(header), 1, pFile);
+	if (!_blockIndex.empty())
+	{
+		fwrite(&_blockIndex[0], sizeof(int), _blockIndex.size(), pFile);
+		fwrite(&_blockDistance[0], sizeof(float), _blockDistance.size(), pFile);
+	}
+	if (!_blockData.empty())
+		fwrite(&_blockData[0], sizeof(float), _blockData.size(), pFile);
+
+	bool ok = !ferror(pFile);
+	fclose(pFile);
+	return ok;
+}
+
+bool SDFCollider::load(const char* fileName, unsigned long long expectedHash)
+{
+	FILE* pFile = fopen(fileName, "rb");
+	if (pFile == NULL)
+		return false;
+
+	SDFFileHeader header;
+	bool ok = fread(&header, sizeof(header), 1, pFile) == 1 && memcmp(header.magic, SDF_FILE_MAGIC, sizeof(header.magic)) == 0
+		&& header.hash == expectedHash && header.numAllocated >= 0;
+	long long numBlocks = 1;
+	int blockDims[3];
+	for (int k = 0; ok && k < 3; ++k)
+	{
+		ok = header.dims[k] >= 2;
+		blockDims[k] = (header.dims[k] + BLOCK - 1) / BLOCK;
+		numBlocks *= blockDims[k];
+	}
+	std::vector<int> blockIndex;
+	std::vector<float> blockDistance;
+	std::vector<float> blockData;
+	if (ok)
+	{
+		blockIndex.resize((size_t)numBlocks);
+		blockDistance.resize((size_t)numBlocks);
+		blockData.resize((size_t)header.numAllocated * BLOCK_NODES);
+		ok = fread(&blockIndex[0], sizeof(int), blockIndex.size(), pFile) == blockIndex.size()
+			&& fread(&blockDistance[0], sizeof(float), blockDistance.size(), pFile) == blockDistance.size()
+			&& (blockData.empty() || fread(&blockData[0], sizeof(float), blockData.size(), pFile) == blockData.size());
+	}
+	for (size_t b = 0; ok && b < blockIndex.size(); ++b)
+		ok = blockIndex[b] >= FAR_INSIDE && blockIndex[b] < header.numAllocated;
+	fclose(pFile);
+	if (!ok)
+		return false;
+
+	_hash = header.hash;
+	_cellSize = header.cellSize;
+	_bandWidth = header.bandWidth;
+	for (int k = 0; k < 3; ++k)
+	{
+		_origin[k] = header.origin[k];
+		_meshBounds.lo[k] = header.boundsLo[k];
+		_meshBounds.hi[k] = header.boundsHi[k];
+		_dims[k] = header.dims[k];
+		_blockDims[k] = blockDims[k];
+	}
+	_blockIndex.swap(blockIndex);
+	_blockDistance.swap(blockDistance);
+	_blockData.swap(blockData);
+	return true;
+}
@@ -0,0 +1,68 @@
+#ifndef SDFCOLLIDER_H
+#define SDFCOLLIDER_H
+
+#include <vector>
+#include "Collider.h"
+#include "ThreadPool.h"
+
+// A static triangle mesh collider backed by a precomputed signed distance field.
+// The distances are sampled on a regular grid of nodes, stored sparsely in blocks of 8x8x8 nodes:
+// only blocks within bandWidth of a triangle are kept, the others only remember whether they are
+// inside or outside (+-bandWidth). A lookup reads 8 nodes and interpolates trilinearly, so its
+// cost does not depend on the triangle count. The sign comes from the parity of ray crossings,
+// so the mesh should be closed. A coarse field of one unclamped distance per block gives the way
+// out where the fine one is flat.
+class SDFCollider : public Collider
+{
+public:
+	SDFCollider() {}
+	// sample the mesh with node spacing cellSize; distances are exact up to bandWidth from the surface.
+	// The blocks are computed in parallel on pool if given
+	SDFCollider(const std::vector<Vec3f>& vertices, const std::vector<Vec3i>& triangles, float cellSize, float bandWidth,
+		ThreadPool* pool = NULL);
+
+	AABB bounds() const { return _meshBounds; }
+	// points deeper inside than bandWidth get the distance -bandWidth. Where the field is flat inside (there, or
+	// at a local maximum of the depth) the normal follows the coarse block distances to the closest band instead
+	float signedDistance(const Vec3f& p, Vec3f& normal) const;
+	float sample(const Vec3f& p) const;  // trilinearly interpolated signed distance
+	Vec3f gradient(const Vec3f& p) const;  // gradient of the interpolated distance (not normalized)
+	float cellSize() const { return _cellSize; }
+	float bandWidth() const { return _bandWidth; }
+	int blockCount() const { return (int)_blockData.size() / BLOCK_NODES; }  // allocated blocks
+
+	// disk cache: load() only accepts a file written for the same mesh and sampling settings
+	static unsigned long long meshHash(const std::vector<Vec3f>& vertices, const std::vector<Vec3i>& triangles, float cellSize, float bandWidth);
+	bool save(const char* fileName) const;
+	bool load(const char* fileName, unsigned long long expectedHash);
+
+private:
+	static const int BLOCK = 8;  // nodes per block edge
+	static const int BLOCK_NODES = BLOCK * BLOCK * BLOCK;
+	static const int FAR_OUTSIDE = -1;  // _blockIndex of blocks without storage
+	static const int FAR_INSIDE = -2;
+
+	unsigned long long _hash = 0;
+	AABB _meshBounds;
+	Vec3f _origin;  // position of node (0, 0, 0)
+	float _cellSize = 1.0f;
+	float _bandWidth = 0.0f;
+	int _dims[3] = { 0, 0, 0 };  // nodes per axis
+	int _blockDims[3] = { 0, 0, 0 };
+	std::vector<int> _blockIndex;  // slot of each block in _blockData, or FAR_OUTSIDE / FAR_INSIDE
+	std::vector<float> _blockData;  // BLOCK_NODES distances per allocated block
+	// signed distance at the center of each block: the node's there for allocated blocks, below -bandWidth
+	// for FAR_INSIDE ones, measured block to block to the band; FAR_OUTSIDE blocks keep +bandWidth
+	std::vector<float> _blockDistance;
+
+	float node(int i, int j, int k) const;
+	void computeBlockDistances();
+	Vec3f coarseGradient(const Vec3f& p) const;  // gradient of the trilinearly interpolated _blockDistance
+	// unit direction from the block of p to its neighbor with the largest _blockDistance, for where even the
+	// coarse field is flat (halfway between two equally close surfaces)
+	Vec3f shallowestNeighbor(const Vec3f& p) const;
+	// node cell containing p and the position inside it; false if p is outside the grid
+	bool locate(const Vec3f& p, int cell[3], Vec3f& frac) const;
+};
+
+#endif
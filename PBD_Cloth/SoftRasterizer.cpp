@@ -0,0 +1,349 @@
+#include "SoftRasterizer.h"
+
+#include <cstring>
+
+// minimum number of vertices / triangles handed to one task of the thread pool
+static const int VERTEX_GRAIN = 4096;
+static const int TRIANGLE_GRAIN = 4096;
+// lines this far inside a tile are drawn without clipping; covers the rounding of the steps along them
+static const float INSIDE_MARGIN = 1.0f / 64;
+// flat shading: the part of the color a triangle seen edge on still gets
+static const float AMBIENT = 0.3f;
+
+// floor and ceil to int without the calls into the math library they turn into on plain x86-64
+static inline int floorInt(float v)
+{
+	int i = (int)v;
+	return i - (i > v);
+}
+
+static inline int ceilInt(float v)
+{
+	int i = (int)v;
+	return i + (i < v);
+}
+
+template<class F>
+static void runParallel(ThreadPool* pool, int begin, int end, int grainSize, const F& func)
+{
+	if (pool)
+		pool->parallelFor(begin, end, grainSize, func);
+	else
+		func(begin, end);
+}
+
+// narrow [lo, hi] to the steps i of a line p + d * i / n whose pixel floor(p + d * i / n) lies in [begin, end);
+// one step of slack on each side, the pixels are checked again
+static void clipSteps(float p, float d, float n, int begin, int end, float& lo, float& hi)
+{
+	if (d == 0.0f)
+	{
+		if (p < begin || p >= end)
+			hi = -1.0f;
+		return;
+	}
+	float t0 = (begin - p) / d * n;
+	float t1 = (end - p) / d * n;
+	if (t0 > t1)
+		std::swap(t0, t1);
+	lo = max(lo, t0 - 1);
+	hi = min(hi, t1 + 1);
+}
+
+SoftRasterizer::SoftRasterizer(int width, int height, ThreadPool* pool)
+	: _width(width), _height(height), _pool(pool)
+{
+	_tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	_tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	_color.resize((size_t)width * height * 3);
+	_depth.resize((size_t)width * height);
+}
+
+void SoftRasterizer::setCamera(const Mat4& view, const Mat4& projection)
+{
+	_view = view;
+	_projection = projection;
+}
+
+void SoftRasterizer::clear(const Vec3f& color)
+{
+	unsigned char bgr[3];
+	toBGR(color, bgr);
+	for (int x = 0; x < TILE_SIZE; ++x)
+		memcpy(&_clearRow[3 * x], bgr, 3);
+	_clearPending = true;  // each tile is cleared right before it is rasterized, while it is in the cache
+	_vertices.clear();
+	_triangles.clear();
+}
+
+void SoftRasterizer::draw(const Vec3f* positions, int numPositions, const unsigned int* indices, int numIndices,
+	const Mat4& model, const Vec3f& color, RasterMode mode)
+{
+	int firstVertex = (int)_vertices.size();
+	_vertices.resize(firstVertex + numPositions);
+	bool shaded = mode == RASTER_FLAT;
+	if (shaded)
+		_eyePositions.resize(numPositions);
+	Mat4 modelView = _view * model;
+	Mat4 modelViewProjection = _projection * modelView;
+	runParallel(_pool, 0, numPositions, VERTEX_GRAIN, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			if (shaded)
+			{
+				Vec4f eye = modelView.transform(positions[i]);
+				_eyePositions[i] = Vec3f(eye[0], eye[1], eye[2]);
+			}
+			Vec4f clip = modelViewProjection.transform(positions[i]);
+			ScreenVertex& vertex = _vertices[firstVertex + i];
+			vertex.visible = clip[2] >= -clip[3] && clip[3] > 0.0f;  // not in front of the near plane
+			float invW = vertex.visible ? 1 / clip[3] : 0.0f;
+			vertex.x = (clip[0] * invW * 0.5f + 0.5f) * _width;
+			vertex.y = (clip[1] * invW * 0.5f + 0.5f) * _height;
+			vertex.z = clip[2] * invW * 0.5f + 0.5f;
+		}
+	});
+
+	unsigned char unshaded[3];
+	toBGR(color, unshaded);
+	int numTriangles = indices ? numIndices / 3 : numPositions / 3;
+	int firstTriangle = (int)_triangles.size();
+	_triangles.resize(firstTriangle + numTriangles);
+	runParallel(_pool, 0, numTriangles, TRIANGLE_GRAIN, [&](int begin, int end)
+	{
+		for (int t = begin; t < end; ++t)
+		{
+			Triangle& triangle = _triangles[firstTriangle + t];
+			int corners[3];
+			bool visible = true;
+			for (int k = 0; k < 3; ++k)
+			{
+				corners[k] = indices ? (int)indices[3 * t + k] : 3 * t + k;
+				triangle.v[k] = firstVertex + corners[k];
+				visible = visible && _vertices[triangle.v[k]].visible;
+			}
+			triangle.mode = visible ? (signed char)mode : -1;
+			if (!visible)
+				continue;
+
+			if (!shaded)
+			{
+				memcpy(triangle.color, unshaded, 3);
+				continue;
+			}
+			// the eye is at the origin of eye space, so the first corner is also the direction it is seen from
+			const Vec3f& p = _eyePositions[corners[0]];
+			Vec3f n = cross(_eyePositions[corners[1]] - p, _eyePositions[corners[2]] - p);
+			float len2 = mag2(n) * mag2(p);
+			toBGR(color * (AMBIENT + (1 - AMBIENT) * (len2 > 0.0f ? std::fabs(dot(n, p)) / std::sqrt(len2) : 0.0f)), triangle.color);
+		}
+	});
+}
+
+void SoftRasterizer::render()
+{
+	// binning: each chunk of triangles sorts its own into the tiles, so the chunks need no locks, and the
+	// tiles go through the chunks in order
+	int numTiles = _tilesX * _tilesY;
+	int numTriangles = (int)_triangles.size();
+	_numChunks = max(1, min(_pool ? 4 * _pool->size() : 1, (numTriangles + TRIANGLE_GRAIN - 1) / TRIANGLE_GRAIN));
+	if ((int)_bins.size() < _numChunks * numTiles)
+		_bins.resize(_numChunks * numTiles);
+	runParallel(_pool, 0, _numChunks, 1, [&](int begin, int end)
+	{
+		for (int c = begin; c < end; ++c)
+		{
+			std::vector<int>* bins = &_bins[c * numTiles];
+			for (int tile = 0; tile < numTiles; ++tile)
+				bins[tile].clear();
+			int first = (int)((long long)numTriangles * c / _numChunks);
+			int last = (int)((long long)numTriangles * (c + 1) / _numChunks);
+			for (int t = first; t < last; ++t)
+			{
+				const Triangle& triangle = _triangles[t];
+				if (triangle.mode < 0)
+					continue;
+				const ScreenVertex& a = _vertices[triangle.v[0]];
+				const ScreenVertex& b = _vertices[triangle.v[1]];
+				const ScreenVertex& d = _vertices[triangle.v[2]];
+				// pixels of filled triangles have their centers inside, lines go through the pixels they touch
+				float minX = min(a.x, b.x, d.x) - 0.5f, maxX = max(a.x, b.x, d.x);
+				float minY = min(a.y, b.y, d.y) - 0.5f, maxY = max(a.y, b.y, d.y);
+				if (maxX < 0.0f || maxY < 0.0f || minX >= _width || minY >= _height)
+					continue;
+				int tx0 = (int)max(minX, 0.0f) / TILE_SIZE, tx1 = (int)min(maxX, _width - 1.0f) / TILE_SIZE;
+				int ty0 = (int)max(minY, 0.0f) / TILE_SIZE, ty1 = (int)min(maxY, _height - 1.0f) / TILE_SIZE;
+				for (int ty = ty0; ty <= ty1; ++ty)
+					for (int tx = tx0; tx <= tx1; ++tx)
+						bins[ty * _tilesX + tx].push_back(t);
+			}
+		}
+	});
+
+	runParallel(_pool, 0, numTiles, 1, [&](int begin, int end)
+	{
+		for (int tile = begin; tile < end; ++tile)
+			rasterizeTile(tile);
+	});
+	_clearPending = false;
+	_vertices.clear();
+	_triangles.clear();
+}
+
+void SoftRasterizer::toBGR(const Vec3f& color, unsigned char* bgr)
+{
+	for (int k = 0; k < 3; ++k)
+		bgr[k] = (unsigned char)(clamp(color[2 - k], 0.0f, 1.0f) * 255 + 0.5f);
+}
+
+void SoftRasterizer::rasterizeTile(int tile)
+{
+	int numTiles = _tilesX * _tilesY;
+	int x0 = (tile % _tilesX) * TILE_SIZE, y0 = (tile / _tilesX) * TILE_SIZE;
+	int x1 = min(x0 + TILE_SIZE, _width), y1 = min(y0 + TILE_SIZE, _height);
+	if (_clearPending)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			memcpy(&_color[3 * ((size_t)y * _width + x0)], _clearRow, 3 * (x1 - x0));
+			std::fill(_depth.begin() + (size_t)y * _width + x0, _depth.begin() + (size_t)y * _width + x1, 1.0f);
+		}
+	}
+	for (int c = 0; c < _numChunks; ++c)
+	{
+		const std::vector<int>& bin = _bins[c * numTiles + tile];
+		for (size_t n = 0; n < bin.size(); ++n)
+		{
+			const Triangle& triangle = _triangles[bin[n]];
+			if (triangle.mode == RASTER_FLAT)
+			{
+				fillTriangle(triangle, x0, y0, x1, y1);
+				continue;
+			}
+			for (int k = 0; k < 3; ++k)
+				drawLine(_vertices[triangle.v[k]], _vertices[triangle.v[(k + 1) % 3]], triangle.color, x0, y0, x1, y1);
+		}
+	}
+}
+
+void SoftRasterizer::fillTriangle(const Triangle& triangle, int x0, int y0, int x1, int y1)
+{
+	const ScreenVertex* a = &_vertices[triangle.v[0]];
+	const ScreenVertex* b = &_vertices[triangle.v[1]];
+	const ScreenVertex* c = &_vertices[triangle.v[2]];
+	float area = (b->x - a->x) * (c->y - a->y) - (b->y - a->y) * (c->x - a->x);
+	if (area == 0.0f)
+		return;
+	if (area < 0.0f)
+	{
+		// both sides are drawn: make it counterclockwise
+		std::swap(b, c);
+		area = -area;
+	}
+
+	// pixel centers within the box of the triangle and the tile
+	// (clamped to the tile as floats first, far away corners do not fit into an int)
+	int bx0 = ceilInt(max((float)x0, min(a->x, b->x, c->x) - 0.5f));
+	int bx1 = floorInt(min((float)x1, max(a->x, b->x, c->x) - 0.5f)) + 1;
+	int by0 = ceilInt(max((float)y0, min(a->y, b->y, c->y) - 0.5f));
+	int by1 = floorInt(min((float)y1, max(a->y, b->y, c->y) - 0.5f)) + 1;
+	bx1 = min(bx1, x1);
+	by1 = min(by1, y1);
+	if (bx0 >= bx1 || by0 >= by1)
+		return;
+
+	// edge functions, positive on the inside; w0 belongs to the edge opposite a and weighs a, and so on
+	const ScreenVertex* from[3] = { b, c, a };
+	const ScreenVertex* to[3] = { c, a, b };
+	float stepX[3], stepY[3], rowStart[3];
+	for (int k = 0; k < 3; ++k)
+	{
+		stepX[k] = from[k]->y - to[k]->y;
+		stepY[k] = to[k]->x - from[k]->x;
+		rowStart[k] = stepY[k] * (by0 + 0.5f - from[k]->y) + stepX[k] * (bx0 + 0.5f - from[k]->x);
+	}
+	// locals, the byte stores into the color buffer could alias anything else
+	float invArea = 1 / area;
+	float za = a->z * invArea, zb = b->z * invArea, zc = c->z * invArea;
+	float* depth = _depth.data();
+	unsigned char* bgr = _color.data();
+	unsigned char color[3] = { triangle.color[0], triangle.color[1], triangle.color[2] };
+	for (int y = by0; y < by1; ++y)
+	{
+		float w0 = rowStart[0], w1 = rowStart[1], w2 = rowStart[2];
+		size_t pixel = (size_t)y * _width + bx0;
+		for (int x = bx0; x < bx1; ++x, ++pixel)
+		{
+			if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f)
+			{
+				float z = w0 * za + w1 * zb + w2 * zc;
+				if (z < depth[pixel])
+				{
+					depth[pixel] = z;
+					memcpy(bgr + 3 * pixel, color, 3);
+				}
+			}
+			w0 += stepX[0];
+			w1 += stepX[1];
+			w2 += stepX[2];
+		}
+		for (int k = 0; k < 3; ++k)
+			rowStart[k] += stepY[k];
+	}
+}
+
+void SoftRasterizer::drawLine(const ScreenVertex& from, const ScreenVertex& to, const unsigned char* lineColor,
+	int x0, int y0, int x1, int y1)
+{
+	// locals, the byte stores into the color buffer could alias anything else
+	float ax = from.x, ay = from.y, az = from.z;
+	float dx = to.x - ax, dy = to.y - ay, dz = to.z - az;
+	float* depth = _depth.data();
+	unsigned char* bgr = _color.data();
+	size_t width = _width;
+	unsigned char color[3] = { lineColor[0], lineColor[1], lineColor[2] };
+
+	// one step per pixel along the longer axis
+	float n = (float)max(ceilInt(max(std::fabs(dx), std::fabs(dy))), 1);
+	float invN = 1 / n;
+	if (min(ax, to.x) >= x0 + INSIDE_MARGIN && max(ax, to.x) < x1 - INSIDE_MARGIN &&
+		min(ay, to.y) >= y0 + INSIDE_MARGIN && max(ay, to.y) < y1 - INSIDE_MARGIN)
+	{
+		// within the tile, as most short edges are: no clipping, and truncating is flooring
+		for (int i = 0; i <= (int)n; ++i)
+		{
+			float t = i * invN;
+			size_t pixel = (size_t)(int)(ay + dy * t) * width + (int)(ax + dx * t);
+			float z = az + dz * t;
+			if (z < depth[pixel])
+			{
+				depth[pixel] = z;
+				memcpy(bgr + 3 * pixel, color, 3);
+			}
+		}
+		return;
+	}
+
+	// only the steps within the tile
+	float lo = 0.0f, hi = n;
+	clipSteps(ax, dx, n, x0, x1, lo, hi);
+	clipSteps(ay, dy, n, y0, y1, lo, hi);
+	if (lo > hi)
+		return;
+	for (int i = ceilInt(lo); i <= (int)hi; ++i)
+	{
+		float t = i * invN;
+		int x = floorInt(ax + dx * t);
+		int y = floorInt(ay + dy * t);
+		if (x < x0 || x >= x1 || y < y0 || y >= y1)
+			continue;
+		size_t pixel = (size_t)y * width + x;
+		float z = az + dz * t;
+		if (z < depth[pixel])
+		{
+			depth[pixel] = z;
+			memcpy(bgr + 3 * pixel, color, 3);
+		}
+	}
+}
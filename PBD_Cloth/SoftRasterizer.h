@@ -0,0 +1,79 @@
+#ifndef SOFTRASTERIZER_H
+#define SOFTRASTERIZER_H
+
+#include <vector>
+#include "Mat4.h"
+#include "ThreadPool.h"
+
+// Draws triangle meshes into a 24 bit color buffer on the CPU, for frames rendered where there is no GPU.
+// draw() transforms a mesh and queues its triangles; render() sorts every queued triangle into the tiles of
+// TILE_SIZE x TILE_SIZE pixels its box overlaps, then rasterizes the tiles in parallel, one thread per tile,
+// so no two threads ever write the same pixel. Within a tile the triangles keep the order they were queued
+// in, so the image does not depend on the number of threads.
+// Depth is tested like glDepthFunc(GL_LESS). RASTER_WIREFRAME draws the edges of the triangles as 1 pixel
+// lines like glPolygonMode(GL_LINE); RASTER_FLAT fills them, dimmed by the angle they are seen at.
+// Triangles with a vertex closer to the eye than the near plane are left out rather than clipped.
+enum RasterMode
+{
+	RASTER_WIREFRAME,
+	RASTER_FLAT
+};
+
+class SoftRasterizer
+{
+public:
+	SoftRasterizer(int width, int height, ThreadPool* pool = NULL);
+
+	int width() const { return _width; }
+	int height() const { return _height; }
+	// rows bottom first, blue green red: the layout of glReadPixels(GL_BGR) with a pack alignment of 1,
+	// so it can go to writeImage() as it is
+	const std::vector<unsigned char>& pixels() const { return _color; }
+
+	void setCamera(const Mat4& view, const Mat4& projection);
+	// start a frame: fill with the color (components from 0 to 1) at the far plane, which render() does, and drop
+	// anything queued
+	void clear(const Vec3f& color);
+	// queue a mesh; indices holds 3 per triangle, or NULL: every 3 consecutive positions are a triangle
+	void draw(const Vec3f* positions, int numPositions, const unsigned int* indices, int numIndices, const Mat4& model,
+		const Vec3f& color, RasterMode mode);
+	void render();  // rasterize everything queued since clear()
+
+private:
+	static const int TILE_SIZE = 64;
+
+	struct ScreenVertex
+	{
+		float x, y;  // in pixels from the bottom left corner
+		float z;  // depth from 0 (near) to 1 (far)
+		bool visible;  // in front of the eye
+	};
+
+	struct Triangle
+	{
+		int v[3];  // into _vertices
+		unsigned char color[3];  // blue green red, shaded
+		signed char mode;  // RasterMode, or -1 if left out
+	};
+
+	int _width, _height;
+	int _tilesX, _tilesY;
+	ThreadPool* _pool;
+	Mat4 _view, _projection;
+	std::vector<unsigned char> _color;
+	std::vector<float> _depth;
+	unsigned char _clearRow[3 * TILE_SIZE];  // a row of a tile in the clear color
+	bool _clearPending = false;
+	std::vector<ScreenVertex> _vertices;  // of all queued meshes
+	std::vector<Vec3f> _eyePositions;  // of the mesh being queued, for the shading
+	std::vector<Triangle> _triangles;
+	int _numChunks = 0;
+	std::vector<std::vector<int> > _bins;  // triangles of chunk c overlapping tile t: _bins[c * numTiles + t]
+
+	static void toBGR(const Vec3f& color, unsigned char* bgr);
+	void rasterizeTile(int tile);
+	void fillTriangle(const Triangle& triangle, int x0, int y0, int x1, int y1);  // within the pixels [x0, x1) x [y0, y1)
+	void drawLine(const ScreenVertex& from, const ScreenVertex& to, const unsigned char* color, int x0, int y0, int x1, int y1);
+};
+
+#endif
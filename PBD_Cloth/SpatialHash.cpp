@@ -0,0 +1,92 @@
+#include "SpatialHash.h"
+
+// minimum number of points / buckets handed to one task of the thread pool
+static const int HASH_GRAIN = 4096;
+
+template<class F>
+static void runParallel(ThreadPool* pool, int begin, int end, int grainSize, const F& func)
+{
+	if (pool)
+		pool->parallelFor(begin, end, grainSize, func);
+	else
+		func(begin, end);
+}
+
+void SpatialHash::build(const Vec3f* positions, int count, float cellSize, ThreadPool* pool)
+{
+	_invCellSize = 1 / cellSize;
+	int tableSize = (int)round_up_to_power_of_two((unsigned int)max(4 * count, 2));
+	_mask = tableSize - 1;
+	if (_countsSize != tableSize)
+	{
+		_counts.reset(new std::atomic<int>[tableSize]);
+		_countsSize = tableSize;
+	}
+	std::atomic<int>* counts = _counts.get();
+	_bucketStart.resize(tableSize + 1);
+	_sorted.resize(count);
+	_pointBucket.resize(count);
+
+	// 1. bucket of every point, counted
+	runParallel(pool, 0, tableSize, HASH_GRAIN, [&](int begin, int end)
+	{
+		for (int h = begin; h < end; ++h)
+			counts[h].store(0, std::memory_order_relaxed);
+	});
+	runParallel(pool, 0, count, HASH_GRAIN, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			const Vec3f& p = positions[i];
+			int h = hashCell((int)std::floor(p[0] * _invCellSize), (int)std::floor(p[1] * _invCellSize), (int)std::floor(p[2] * _invCellSize));
+			_pointBucket[i] = h;
+			counts[h].fetch_add(1, std::memory_order_relaxed);
+		}
+	});
+
+	// 2. exclusive prefix sum: block sums in parallel, a serial scan over the blocks, then the blocks in parallel
+	int numBlocks = (tableSize + HASH_GRAIN - 1) / HASH_GRAIN;
+	std::vector<int> blockStart(numBlocks + 1, 0);
+	runParallel(pool, 0, numBlocks, 1, [&](int begin, int end)
+	{
+		for (int b = begin; b < end; ++b)
+		{
+			int sum = 0;
+			for (int h = b * HASH_GRAIN; h < min((b + 1) * HASH_GRAIN, tableSize); ++h)
+				sum += counts[h].load(std::memory_order_relaxed);
+			blockStart[b + 1] = sum;
+		}
+	});
+	for (int b = 0; b < numBlocks; ++b)
+		blockStart[b + 1] += blockStart[b];
+	runParallel(pool, 0, numBlocks, 1, [&](int begin, int end)
+	{
+		for (int b = begin; b < end; ++b)
+		{
+			int start = blockStart[b];
+			for (int h = b * HASH_GRAIN; h < min((b + 1) * HASH_GRAIN, tableSize); ++h)
+			{
+				int n = counts[h].load(std::memory_order_relaxed);
+				_bucketStart[h] = start;
+				counts[h].store(start, std::memory_order_relaxed);  // now the insert cursor of the bucket
+				start += n;
+			}
+		}
+	});
+	_bucketStart[tableSize] = count;
+
+	// 3. scatter the ids, then sort each bucket so the order does not depend on the thread timing
+	runParallel(pool, 0, count, HASH_GRAIN, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+			_sorted[counts[_pointBucket[i]].fetch_add(1, std::memory_order_relaxed)] = i;
+	});
+	runParallel(pool, 0, tableSize, HASH_GRAIN, [&](int begin, int end)
+	{
+		for (int h = begin; h < end; ++h)
+		{
+			if (_bucketStart[h + 1] - _bucketStart[h] > 1)
+				std::sort(_sorted.begin() + _bucketStart[h], _sorted.begin() + _bucketStart[h + 1]);
+		}
+	});
+}
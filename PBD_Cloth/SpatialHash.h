@@ -0,0 +1,60 @@
+#ifndef SPATIALHASH_H
+#define SPATIALHASH_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "Vec.h"
+#include "ThreadPool.h"
+
+// Uniform grid of cubic cells over an unbounded domain, hashed into a table of about four buckets per point.
+// build() counting-sorts the point ids by the hash of their cell, in parallel if a pool is given;
+// forEachNeighbor() visits the points of the 8 cells closest to a position, so all points within half
+// a cell size are found. Points of other cells sharing a hash bucket are visited as well: callers
+// have to check the distance.
+class SpatialHash
+{
+public:
+	void build(const Vec3f* positions, int count, float cellSize, ThreadPool* pool = NULL);
+
+	// func(j) for each point j hashed into the 2x2x2 cells nearest to p; those cover the ball of radius cellSize / 2
+	// around p. A bucket shared by several of the cells is visited once
+	template<class F>
+	void forEachNeighbor(const Vec3f& p, const F& func) const
+	{
+		int lo[3], step[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			float g = p[k] * _invCellSize;
+			lo[k] = (int)std::floor(g);
+			step[k] = g - lo[k] < 0.5f ? -1 : 1;  // toward the closer neighbor cell
+		}
+		int visited[8];
+		int numVisited = 0;
+		for (int n = 0; n < 8; ++n)
+		{
+			int h = hashCell(lo[0] + (n & 1) * step[0], lo[1] + ((n >> 1) & 1) * step[1], lo[2] + (n >> 2) * step[2]);
+			if (std::find(visited, visited + numVisited, h) != visited + numVisited)
+				continue;
+			visited[numVisited++] = h;
+			for (int e = _bucketStart[h]; e < _bucketStart[h + 1]; ++e)
+				func(_sorted[e]);
+		}
+	}
+
+private:
+	float _invCellSize = 1.0f;
+	int _mask = 0;  // table size - 1
+	std::vector<int> _bucketStart;  // points of bucket h are _sorted[start[h], start[h+1]), ascending
+	std::vector<int> _sorted;
+	std::vector<int> _pointBucket;
+	std::unique_ptr<std::atomic<int>[]> _counts;  // per bucket counters of the sort
+	int _countsSize = 0;
+
+	int hashCell(int x, int y, int z) const
+	{
+		return (int)(((unsigned int)x * 73856093u) ^ ((unsigned int)y * 19349663u) ^ ((unsigned int)z * 83492791u)) & _mask;
+	}
+};
+
+#endif
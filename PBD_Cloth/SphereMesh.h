@@ -0,0 +1,52 @@
+#ifndef SPHEREMESH_H
+#define SPHEREMESH_H
+
+#include <cmath>
+#include <vector>
+#include "Util.h"
+#include "Vec.h"
+
+// The unit sphere drawn for the sphere colliders, shared by the viewer and the software rasterizer:
+// 10 degree steps of latitude and longitude, two triangles per patch. The patches share their corners, so
+// the mesh is SPHERE_RINGS x SPHERE_SEGMENTS vertices indexed by SPHERE_INDICES indices.
+#define SPHERE_RINGS 19  // latitudes from -90 to 90 degrees, both poles included
+#define SPHERE_SEGMENTS 36  // longitudes from -180 to 170 degrees
+#define SPHERE_INDICES ((SPHERE_RINGS - 1) * SPHERE_SEGMENTS * 6)
+
+inline void sphereMesh(std::vector<Vec3f>& vertices, std::vector<unsigned int>& indices)
+{
+	float DegreesToRadians = M_PI / 180.0;
+	vertices.resize(SPHERE_RINGS * SPHERE_SEGMENTS);
+	for (int i = 0; i < SPHERE_RINGS; ++i)
+	{
+		float phiR = (-90.0f + 10.0f * i) * DegreesToRadians;
+		for (int j = 0; j < SPHERE_SEGMENTS; ++j)
+		{
+			float thetaR = (-180.0f + 10.0f * j) * DegreesToRadians;
+			vertices[i * SPHERE_SEGMENTS + j] = Vec3f(sin(thetaR) * cos(phiR), cos(thetaR) * cos(phiR), sin(phiR));
+		}
+	}
+
+	indices.clear();
+	indices.reserve(SPHERE_INDICES);
+	for (int i = 0; i + 1 < SPHERE_RINGS; ++i)
+	{
+		for (int j = 0; j < SPHERE_SEGMENTS; ++j)
+		{
+			// In every square
+			// A1 - B1
+			// | \  |
+			// |  \ |
+			// A2 - B2
+			int next = (j + 1) % SPHERE_SEGMENTS;
+			unsigned int A1 = i * SPHERE_SEGMENTS + j;
+			unsigned int B1 = (i + 1) * SPHERE_SEGMENTS + j;
+			unsigned int B2 = (i + 1) * SPHERE_SEGMENTS + next;
+			unsigned int A2 = i * SPHERE_SEGMENTS + next;
+			unsigned int patch[6] = { A1, B1, B2, B2, A2, A1 };
+			indices.insert(indices.end(), patch, patch + 6);
+		}
+	}
+}
+
+#endif
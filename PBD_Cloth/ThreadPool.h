@@ -0,0 +1,183 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Util.h"
+
+// A fixed set of worker threads shared by the solver loops.
+// parallelFor splits an index range into chunks and blocks until all of them are done;
+// the calling thread works on chunks as well, so nested calls from inside a task cannot deadlock.
+// enqueue runs a task asynchronously; wait blocks until every enqueued task has finished.
+class ThreadPool
+{
+public:
+	// numThreads counts the calling thread; 0 uses one thread per hardware core
+	explicit ThreadPool(int numThreads = 0)
+		: _stop(false), _pending(0)
+	{
+		if (numThreads <= 0)
+			numThreads = (int)std::thread::hardware_concurrency();
+		for (int i = 1; i < numThreads; ++i)
+			_workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_taskReady.notify_all();
+		for (size_t i = 0; i < _workers.size(); ++i)
+			_workers[i].join();
+	}
+
+	int size() const { return (int)_workers.size() + 1; }
+
+	// run func(chunkBegin, chunkEnd) over [begin, end) in chunks of at least grainSize indices
+	template<class F>
+	void parallelFor(int begin, int end, int grainSize, const F& func)
+	{
+		int count = end - begin;
+		if (count <= 0)
+			return;
+		if (grainSize < 1)
+			grainSize = 1;
+		int numChunks = min((count + grainSize - 1) / grainSize, 4 * size());
+		if (numChunks <= 1 || _workers.empty())
+		{
+			func(begin, end);
+			return;
+		}
+
+		// the job outlives this call if a helper task is dequeued after all chunks are done
+		struct Job
+		{
+			std::atomic<int> next;
+			std::atomic<int> done;
+		};
+		std::shared_ptr<Job> job = std::make_shared<Job>();
+		job->next = 0;
+		job->done = 0;
+		int chunkSize = (count + numChunks - 1) / numChunks;
+		numChunks = (count + chunkSize - 1) / chunkSize;
+		std::function<void()> runChunks = [job, begin, end, chunkSize, numChunks, &func]()
+		{
+			for (int c = job->next++; c < numChunks; c = job->next++)
+			{
+				int chunkBegin = begin + c * chunkSize;
+				func(chunkBegin, min(chunkBegin + chunkSize, end));
+				job->done++;
+			}
+		};
+
+		int numHelpers = min(numChunks - 1, (int)_workers.size());
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			for (int i = 0; i < numHelpers; ++i)
+				_tasks.push_front(runChunks);  // ahead of any asynchronous work
+			_pending += numHelpers;
+		}
+		if (numHelpers == 1)
+			_taskReady.notify_one();
+		else
+			_taskReady.notify_all();
+
+		runChunks();
+		while (job->done.load() < numChunks)
+			std::this_thread::yield();
+	}
+
+	// parallel reduction: combine(func(chunkBegin, chunkEnd)...) starting from identity
+	template<class T, class F, class R>
+	T parallelReduce(int begin, int end, int grainSize, T identity, const F& func, const R& combine)
+	{
+		int count = end - begin;
+		if (count <= 0)
+			return identity;
+		if (grainSize < 1)
+			grainSize = 1;
+		int numChunks = min((count + grainSize - 1) / grainSize, 4 * size());
+		int chunkSize = (count + numChunks - 1) / numChunks;
+		numChunks = (count + chunkSize - 1) / chunkSize;
+		std::vector<T> partial(numChunks, identity);
+		parallelFor(0, numChunks, 1, [&](int c0, int c1)
+		{
+			for (int c = c0; c < c1; ++c)
+			{
+				int chunkBegin = begin + c * chunkSize;
+				partial[c] = func(chunkBegin, min(chunkBegin + chunkSize, end));
+			}
+		});
+		T result = identity;
+		for (int c = 0; c < numChunks; ++c)
+			result = combine(result, partial[c]);
+		return result;
+	}
+
+	// run a task asynchronously on one of the workers (inline if the pool has none)
+	void enqueue(std::function<void()> task)
+	{
+		if (_workers.empty())
+		{
+			task();
+			return;
+		}
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_tasks.push_back(task);
+			_pending++;
+		}
+		_taskReady.notify_one();
+	}
+
+	// block until all enqueued tasks have finished
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_allDone.wait(lock, [this]() { return _pending == 0; });
+	}
+
+private:
+	std::vector<std::thread> _workers;
+	std::deque<std::function<void()> > _tasks;
+	std::mutex _mutex;
+	std::condition_variable _taskReady;
+	std::condition_variable _allDone;
+	bool _stop;
+	int _pending;  // queued or running tasks
+
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	void workerLoop()
+	{
+		for (;;)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_taskReady.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+				if (_stop && _tasks.empty())
+					return;
+				task = _tasks.front();
+				_tasks.pop_front();
+			}
+			task();
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				if (--_pending == 0)
+					_allDone.notify_all();
+			}
+		}
+	}
+};
+
+#endif
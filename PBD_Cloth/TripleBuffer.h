@@ -0,0 +1,46 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+// Lock-free hand-off of the latest value from one producer thread to one consumer thread.
+// There are three slots: the producer fills its back slot and publish() swaps it with the middle one, the
+// consumer's update() swaps its front slot with the middle one if something new was published since.
+// Neither side ever waits for the other, the producer never touches the slot the consumer reads, and the
+// consumer always gets the most recently published value; older ones it did not pick up are overwritten.
+template<class T>
+class TripleBuffer
+{
+public:
+	explicit TripleBuffer(const T& initial = T())
+		: _back(0), _middle(1), _front(2)
+	{
+		for (int i = 0; i < 3; ++i)
+			_slots[i] = initial;
+	}
+
+	// producer side
+	T& back() { return _slots[_back]; }
+	void publish() { _back = _middle.exchange(_back | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+	// consumer side: take the latest published value; false if there was none since the last call
+	bool update()
+	{
+		if (!(_middle.load(std::memory_order_relaxed) & FRESH))
+			return false;
+		_front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+	const T& front() const { return _slots[_front]; }
+
+private:
+	static const int INDEX = 3;  // slot bits of _middle
+	static const int FRESH = 4;  // set by publish(), cleared once the consumer took the slot
+
+	T _slots[3];
+	int _back;  // only touched by the producer
+	std::atomic<int> _middle;
+	int _front;  // only touched by the consumer
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <vector>
 #include <cmath>
+#include <climits>
 #include <iostream>
 
 #ifndef M_PI